@@ -26,6 +26,7 @@ namespace cat_grammar
 	struct DefLabel			{ static const int id = 7; };
 	struct ArrowLabel		{ static const int id = 8; };
 	struct TypeVectorLabel	{ static const int id = 9; };
+	struct MetaDataLabel	{ static const int id = 10; };
 
 	// Character sets 
 	struct CatWordSymbolCharSet : CharSet<'~', '`', '!', '@', '#', '$', '%', '^', '&', '*', '_', '+', '-', '=', '\\', ':', ';', '<', '>', '.', '?', '/'> { };
@@ -61,8 +62,9 @@ namespace cat_grammar
 	struct TypeVector : Store<TypeVectorLabel, Star<Type> > { };
 	struct FxnType : StoreIf<FxnTypeLabel, Char<'('>, Seq<WS, TypeVector, Arrow, WS, TypeVector, ExpectChar<')'>, WS > > { };
 	struct FxnTypeDecl : FinaoIf<Char<':'>, Seq<WS, FxnType> > { };
+	struct MetaDataBlock : StoreIf<MetaDataLabel, At<CharSeq<'{', '{'> >, Seq<CharSeq<'{', '{'>, UntilPast<CharSeq<'}', '}'> >, WS> > { };
 	struct DefineKeyword : Seq<Word<CharSeq<'d','e','f','i','n','e'> >, WS> { };
-	struct Def : StoreIf<DefLabel, DefineKeyword, Seq<CatWord, WS, Opt<FxnTypeDecl>, FxnBody> > { };
+	struct Def : StoreIf<DefLabel, DefineKeyword, Seq<CatWord, WS, Opt<FxnTypeDecl>, Opt<MetaDataBlock>, FxnBody> > { };
 	struct SourceFile : Star<Seq<WS, Def> > { };
 }
 
@@ -4,6 +4,8 @@
 
 #define _CRT_SECURE_NO_DEPRECATE
 
+#include <ctype.h>
+
 #include "..\yard\yard.hpp"
 #include "..\ootl\ootl_stack.hpp"
 #include "..\ootl\ootl_hash.hpp"
@@ -18,6 +20,9 @@ typedef CatParser::Iterator Iterator;
 
 ootl::hash_map<Node*, int> anon_fxns;
 
+// every definition, in the order of the source
+ootl::stack<Node*> all_defs;
+
 void printch(char c)
 {
 	switch (c)
@@ -61,6 +66,20 @@ void OutputNodeText(Node* p)
 		putchar(*i++);
 }
 
+void OutputNodeTextAsString(Node* p)
+{
+	putchar('"');
+	Iterator i = p->GetFirstToken();	
+	while (i != p->GetLastToken())
+	{
+		char c = *i++;
+		if (c == '\\' || c == '"')
+			putchar('\\');
+		putchar(c);
+	}
+	putchar('"');
+}
+
 void OutputName(Node* p)
 {
 	assert(p->GetLabelId() == CatWordLabel::id);
@@ -80,11 +99,245 @@ void OutputFxnSig(Node* p)
 	printf("()");
 }
 
+Node* GetChild(Node* p, int nLabelId)
+{
+	Node* pTmp = p->GetFirstChild();
+	while (pTmp != NULL && pTmp->GetLabelId() != nLabelId)
+		pTmp = pTmp->GetSibling();
+	return pTmp;
+}
+
+// Memoization is requested in a definition's meta-data block:
+//   {{ 
+//     memo: 
+//       memory 
+//   }}
+// or "disk" in place of "memory" to also use the persistent cache. 
+enum MemoMode { NoMemo, MemoryMemo, DiskMemo };
+
+MemoMode GetMemoMode(Node* p)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	Node* pMeta = GetChild(p, MetaDataLabel::id);
+	if (pMeta == NULL)
+		return NoMemo;
+	const char* sLabel = "memo:";
+	Iterator i = pMeta->GetFirstToken();	
+	while (i != pMeta->GetLastToken())
+	{
+		Iterator j = i;
+		const char* k = sLabel;
+		while (*k != '\0' && j != pMeta->GetLastToken() && *j == *k) 
+		{
+			++j;
+			++k;
+		}
+		if (*k == '\0')
+		{
+			while (j != pMeta->GetLastToken() && isspace(*j))
+				++j;
+			const char* sDisk = "disk";
+			k = sDisk;
+			while (*k != '\0' && j != pMeta->GetLastToken() && *j == *k) 
+			{
+				++j;
+				++k;
+			}
+			return *k == '\0' ? DiskMemo : MemoryMemo;
+		}
+		++i;
+	}
+	return NoMemo;
+}
+
+// Counts the types consumed and produced by a definition. Returns false if 
+// there is no type declaration, or if it contains a stack variable such as 'A. 
+bool GetArity(Node* p, int& nIn, int& nOut)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	Node* pType = GetChild(p, FxnTypeLabel::id);
+	if (pType == NULL)
+		return false;
+	int* pCount = &nIn;
+	nIn = 0;
+	nOut = 0;
+	Node* pVec = pType->GetFirstChild();
+	while (pVec != NULL)
+	{
+		if (pVec->GetLabelId() == TypeVectorLabel::id)
+		{
+			Node* pTmp = pVec->GetFirstChild();
+			while (pTmp != NULL) 
+			{
+				if (pTmp->GetLabelId() == KindVarLabel::id)
+				{
+					Iterator i = pTmp->GetFirstToken();
+					if (*i == '\'') ++i;
+					if (*i >= 'A' && *i <= 'Z')
+						return false;
+				}
+				++*pCount;
+				pTmp = pTmp->GetSibling();
+			}
+			pCount = &nOut;
+		}
+		pVec = pVec->GetSibling();
+	}
+	return true;
+}
+
+bool NodeTextEquals(Node* p, const char* s)
+{
+	Iterator i = p->GetFirstToken();	
+	while (i != p->GetLastToken())
+		if (*s == '\0' || *i++ != *s++)
+			return false;
+	return *s == '\0';
+}
+
+// Library definitions which the runtime implements natively (see cat_lib.hpp).
+// Only their declarations are output.
+const char* native_defs[] = {
+	"cat", "count", "curry", "drop", "flatten", "nth", "rcurry", "rev", "split_at", "take", NULL
+};
+
+bool IsNative(Node* p)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	for (const char** s = native_defs; *s != NULL; ++s)
+		if (NodeTextEquals(p->GetFirstChild(), *s))
+			return true;
+	return false;
+}
+
+// Returns true if every type consumed or produced by a definition is an int.
+bool IsIntSignature(Node* p)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	Node* pType = GetChild(p, FxnTypeLabel::id);
+	if (pType == NULL)
+		return false;
+	Node* pVec = pType->GetFirstChild();
+	while (pVec != NULL)
+	{
+		if (pVec->GetLabelId() == TypeVectorLabel::id)
+		{
+			Node* pTmp = pVec->GetFirstChild();
+			while (pTmp != NULL) 
+			{
+				if (pTmp->GetLabelId() != NamedTypeLabel::id || !NodeTextEquals(pTmp, "int"))
+					return false;
+				pTmp = pTmp->GetSibling();
+			}
+		}
+		pVec = pVec->GetSibling();
+	}
+	return true;
+}
+
+// Hashes the text of a definition's body, continuing from "hash".
+ootl::u8 HashDefBody(Node* p, ootl::u8 hash)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	Node* pTmp = GetChild(p, ExprLabel::id);
+	if (pTmp == NULL)
+		return hash;
+	Iterator i = pTmp->GetFirstToken();	
+	while (pTmp->HasSibling())
+		pTmp = pTmp->GetSibling();
+	while (i != pTmp->GetLastToken())
+	{
+		char c = *i++;
+		hash = ootl::fnv_hash(&c, 1, hash);
+	}
+	return hash;
+}
+
+void CollectDef(Node* p)
+{
+	all_defs.push(p);
+}
+
+bool NodeTextsEqual(Node* a, Node* b)
+{
+	Iterator i = a->GetFirstToken();
+	Iterator j = b->GetFirstToken();
+	while (i != a->GetLastToken() && j != b->GetLastToken())
+		if (*i++ != *j++)
+			return false;
+	return i == a->GetLastToken() && j == b->GetLastToken();
+}
+
+// Returns the definition named by a word, or NULL for primitives.
+Node* FindDef(Node* pWord)
+{
+	for (size_t i=0; i < all_defs.count(); ++i)
+		if (NodeTextsEqual(all_defs[i]->GetFirstChild(), pWord))
+			return all_defs[i];
+	return NULL;
+}
+
+// Adds the definitions called from the node p and its siblings, including 
+// those called from quotations and by the callees, to "defs" once each.
+void CollectCallees(Node* p, ootl::stack<Node*>& defs)
+{
+	for (; p != NULL; p = p->GetSibling())
+	{
+		if (p->GetLabelId() != CatWordLabel::id)
+		{
+			CollectCallees(p->GetFirstChild(), defs);
+			continue;
+		}
+		Node* pDef = FindDef(p);
+		if (pDef == NULL)
+			continue;
+		size_t i = 0;
+		while (i < defs.count() && defs[i] != pDef)
+			++i;
+		if (i < defs.count())
+			continue;
+		defs.push(pDef);
+		CollectCallees(GetChild(pDef, ExprLabel::id), defs);
+	}
+}
+
+// Hashes the bodies of a definition and of every definition it calls. This 
+// identifies the version of a definition in persistent memoization caches,
+// so editing a callee invalidates the entries of its callers. Changes to 
+// primitives of the runtime aren't detected. 
+ootl::u8 HashDef(Node* p)
+{
+	ootl::stack<Node*> defs;
+	defs.push(p);
+	CollectCallees(GetChild(p, ExprLabel::id), defs);
+	ootl::u8 hash = ootl::fnv_hash(NULL, 0);
+	for (size_t i=0; i < defs.count(); ++i)
+	{
+		// separates the bodies 
+		hash = ootl::fnv_hash("", 1, hash);
+		hash = HashDefBody(defs[i], hash);
+	}
+	return hash;
+}
+
+void OutputMemoBodySig(Node* p)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	printf("void ");
+	OutputName(p->GetFirstChild());
+	printf("_memo_body()");
+}
+
 void OutputForwardDecls(Node* p)
 {
 	assert(p->GetLabelId() == DefLabel::id);
 	OutputFxnSig(p);
 	printf(";\n");
+	if (GetMemoMode(p) != NoMemo) 
+	{
+		OutputMemoBodySig(p);
+		printf(";\n");
+	}
 }
 
 void OutputQuotationForwardDecls(Node* p)
@@ -121,6 +374,68 @@ void OutputLiteral(Node* p)
 	printf(");\n");
 }
 
+// Returns the child of an expression if it has the given label, or NULL
+Node* GetExprOf(Node* pExpr, int nLabelId)
+{
+	if (pExpr == NULL || pExpr->GetLabelId() != ExprLabel::id)
+		return NULL;
+	Node* pChild = pExpr->GetFirstChild();
+	return pChild->GetLabelId() == nLabelId ? pChild : NULL;
+}
+
+bool IsWord(Node* pExpr, const char* s)
+{
+	Node* p = GetExprOf(pExpr, CatWordLabel::id);
+	return p != NULL && NodeTextEquals(p, s);
+}
+
+// Returns the literal in a quotation which holds only a literal, or NULL
+Node* GetQuotedLiteral(Node* pQuotation)
+{
+	if (pQuotation == NULL) 
+		return NULL;
+	Node* pExpr = pQuotation->GetFirstChild();
+	if (pExpr == NULL || pExpr->HasSibling())
+		return NULL;
+	return GetExprOf(pExpr, LiteralLabel::id);
+}
+
+// Binding a literal to a quotation makes a closure (see cat_lib.hpp), which
+// is output directly for "x [f] curry", "[f] x rcurry" and "[x] [f] compose".
+// Returns the last expression of the pattern, or NULL if there is none.
+Node* OutputClosure(Node* pExpr)
+{
+	Node* pNext = pExpr->GetSibling();
+	Node* pLast = pNext == NULL ? NULL : pNext->GetSibling();
+	if (pLast == NULL)
+		return NULL;
+	Node* pValue = NULL;
+	Node* pFxn = NULL;
+	if (IsWord(pLast, "curry"))
+	{
+		pValue = GetExprOf(pExpr, LiteralLabel::id);
+		pFxn = GetExprOf(pNext, QuotationLabel::id);
+	}
+	else if (IsWord(pLast, "rcurry"))
+	{
+		pFxn = GetExprOf(pExpr, QuotationLabel::id);
+		pValue = GetExprOf(pNext, LiteralLabel::id);
+	}
+	else if (IsWord(pLast, "compose"))
+	{
+		pValue = GetQuotedLiteral(GetExprOf(pExpr, QuotationLabel::id));
+		pFxn = GetExprOf(pNext, QuotationLabel::id);
+	}
+	if (pValue == NULL || pFxn == NULL)
+		return NULL;
+	printf("    push_closure(_cat_anon%d, ", anon_fxns[pFxn]);
+	OutputNodeText(pValue);
+	printf("); //");
+	OutputNodeText(pFxn);
+	printf("\n");
+	return pLast;
+}
+
 void OutputExpr(Node* p)
 {
 	assert(p->GetLabelId() == ExprLabel::id);	
@@ -143,15 +458,62 @@ void OutputExpr(Node* p)
 	}
 }
 
-void OutputFunctionDefs(Node* p)
+// A memoized definition is split in two: the body, and an entry point which 
+// looks up the arguments in the cache before calling the body. The hash of 
+// the definition and its callees is part of the cache key, so editing any 
+// of them invalidates the old entries.
+void OutputMemoEntryPoint(Node* p, MemoMode mode)
 {
+	int nIn;
+	int nOut;
+	if (!GetArity(p, nIn, nOut))
+	{
+		printf("#error memoized definitions require a type without stack variables\n");
+		return;
+	}
 	OutputFxnSig(p);
 	printf("\n{\n");
+	if (mode == MemoryMemo && nIn >= 1 && nIn <= 2 && nOut == 1 && IsIntSignature(p))
+	{
+		// integer functions, such as fib, have a faster table
+		printf("    memo_call_int(");
+		OutputName(p->GetFirstChild());
+		printf("_memo_body, 0x%016llxULL, %d);\n", HashDef(p), nIn);
+	}
+	else
+	{
+		printf("    memo_call(");
+		OutputName(p->GetFirstChild());
+		printf("_memo_body, 0x%016llxULL, %d, %d, %s);\n", 
+			HashDef(p), nIn, nOut, mode == DiskMemo ? "true" : "false");
+	}
+	printf("}\n");
+}
+
+void OutputFunctionDefs(Node* p)
+{
+	if (IsNative(p))
+		return;
+	MemoMode mode = GetMemoMode(p);
+	if (mode != NoMemo)
+	{
+		OutputMemoEntryPoint(p, mode);
+		OutputMemoBodySig(p);
+	}
+	else
+	{
+		OutputFxnSig(p);
+	}
+	printf("\n{\n");
 	Node* pTmp = p->GetFirstChild();
 	while (pTmp != NULL) {
 		if (pTmp->GetLabelId() == ExprLabel::id)
 		{
-			OutputExpr(pTmp);
+			Node* pLast = OutputClosure(pTmp);
+			if (pLast != NULL)
+				pTmp = pLast;
+			else
+				OutputExpr(pTmp);
 		}
 		pTmp = pTmp->GetSibling();
 	}
@@ -166,12 +528,30 @@ void OutputQuotationDefs(Node* p)
 	Node* pTmp = p->GetFirstChild();
 	while (pTmp != NULL) {
 		assert(pTmp->GetLabelId() == ExprLabel::id);
-		OutputExpr(pTmp);
+		Node* pLast = OutputClosure(pTmp);
+		if (pLast != NULL)
+			pTmp = pLast;
+		else
+			OutputExpr(pTmp);
 		pTmp = pTmp->GetSibling();
 	}
 	printf("}\n");
 }
 
+void OutputDefTableEntry(Node* p)
+{
+	assert(p->GetLabelId() == DefLabel::id);
+	if (IsNative(p))
+		return;
+	Node* pName = p->GetFirstChild();
+	assert(pName != NULL);
+	printf("    { ");
+	OutputNodeTextAsString(pName);
+	printf(", ");
+	OutputName(pName);
+	printf(", 0x%016llxULL },\n", HashDef(p));
+}
+
 void test_hash()
 {
 	ootl::hash_map<int, int> h;
@@ -214,9 +594,10 @@ int main(int argc, char* argv[])
 
 	// get data from file
 	ootl::stack<char> char_stk; 
-	int c; 	
-	while ((c = getchar()) != EOF)
-		char_stk.push(c);
+	char read_buf[4096];
+	size_t nread;
+	while ((nread = fread(read_buf, 1, sizeof(read_buf), stdin)) > 0)
+		char_stk.append_range(read_buf, read_buf + nread);
 
 	// close standard in, does nothing if not redirected
 	fclose(in);
@@ -224,7 +605,7 @@ int main(int argc, char* argv[])
 	// allocate a buffer of characters
 	size_t n = char_stk.count();
 	char* char_buf = new char[n];
-	char_stk.copy_to_array(char_buf);
+	char_stk.copy_out(char_buf);
 	
 	CatParser p(char_buf, char_buf + n);
 		
@@ -241,10 +622,14 @@ int main(int argc, char* argv[])
 			printf("// by Christopher Diggins\n\n");
 			printf("// http://www.cat-language.com\n");
 			printf("\n");
+			p.GetAstRoot()->Visit(CollectDef, DefLabel::id);
 			p.GetAstRoot()->Visit(OutputForwardDecls, DefLabel::id);
 			p.GetAstRoot()->Visit(OutputQuotationForwardDecls, QuotationLabel::id);
 			p.GetAstRoot()->Visit(OutputFunctionDefs, DefLabel::id);
 			p.GetAstRoot()->Visit(OutputQuotationDefs, QuotationLabel::id);
+			printf("cat_def cat_lib_defs[] = {\n");
+			p.GetAstRoot()->Visit(OutputDefTableEntry, DefLabel::id);
+			printf("    { NULL, NULL, 0 }\n};\n");
 		}
 		catch(...)
 		{
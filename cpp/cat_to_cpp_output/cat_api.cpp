@@ -0,0 +1,558 @@
+// Public domain Cat interpreter 
+// http://www.cat-language.com
+//
+// Implementation of the C hosting interface declared in cat_api.h. 
+// This file is compiled into a library, in place of cat_cpp_output.cpp. 
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "cat_lib.hpp"
+#include "cat_memo.hpp"
+#include "output.hpp"
+#include "cat_api.h"
+
+// thrown by cat_fail while a context is executing
+struct cat_failure
+{
+	cat_failure(const char* s) : msg(s) { }
+	const char* msg;
+};
+
+void throw_failure(const char* msg)
+{
+	throw cat_failure(msg);
+}
+
+struct cat_context
+{
+	cat_context()
+	{
+		error[0] = '\0';
+	}
+	~cat_context()
+	{
+		data.clear();
+		while (!strings.is_empty())
+			free(strings.pull());
+	}
+	data_stack data;
+	memo_context memo;
+	stack<char*> strings;
+	char error[256];
+};
+
+// records a message in the context, if there is one
+cat_error set_error(cat_context* ctx, cat_error err, const char* msg)
+{
+	if (ctx == NULL)
+		return err;
+	strncpy(ctx->error, msg, sizeof(ctx->error) - 1);
+	ctx->error[sizeof(ctx->error) - 1] = '\0';
+	return err;
+}
+
+cat_error type_error(cat_context* ctx, const object::bad_object_cast& e)
+{
+	char buf[256];
+	sprintf(buf, "type error casting from %.100s to %.100s", e.from.name(), e.to.name());
+	return set_error(ctx, CAT_ERR_TYPE, buf);
+}
+
+template<typename T>
+cat_error push_value(cat_context* ctx, const T& x)
+{
+	if (ctx == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	try
+	{
+		ctx->data.push(x);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return set_error(ctx, CAT_ERR_OUT_OF_MEMORY, "out of memory");
+	}
+	return CAT_OK;
+}
+
+template<typename T>
+cat_error pop_value(cat_context* ctx, T* out)
+{
+	if (ctx == NULL || out == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	if (ctx->data.is_empty())
+		return set_error(ctx, CAT_ERR_UNDERFLOW, "stack is empty");
+	if (!ctx->data.top().is<T>())
+	{
+		object::bad_object_cast e(ctx->data.top().type_info(), typeid(T));
+		return type_error(ctx, e);
+	}
+	*out = ctx->data.top().to<T>();
+	ctx->data.pop();
+	return CAT_OK;
+}
+
+// Runs a definition on the current thread's stack, translating failures 
+// into error codes. 
+cat_error invoke(fxn_ptr f, cat_context* ctx)
+{
+	cat_error err = CAT_OK;
+	void (*old_fail)(const char*) = cat_fail;
+	cat_fail = throw_failure;
+	try
+	{
+		f();
+	}
+	catch (const object::bad_object_cast& e)
+	{
+		err = type_error(ctx, e);
+	}
+	catch (const cat_failure& e)
+	{
+		err = set_error(ctx, e.msg == cat_underflow_msg ? CAT_ERR_UNDERFLOW : CAT_ERR_FAILED, e.msg);
+	}
+	catch (cat_exception&)
+	{
+		err = set_error(ctx, CAT_ERR_EXCEPTION, "uncaught exception");
+	}
+	catch (const std::bad_alloc&)
+	{
+		err = set_error(ctx, CAT_ERR_OUT_OF_MEMORY, "out of memory");
+	}
+	catch (...)
+	{
+		err = set_error(ctx, CAT_ERR_EXCEPTION, "unhandled exception");
+	}
+	cat_fail = old_fail;
+	return err;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// batch evaluation
+
+// number of items a thread claims at once
+const int batch_chunk = 64;
+
+struct batch_job
+{
+	fxn_ptr fxn;
+	const cat_value* inputs;
+	int in_arity;
+	cat_value* outputs;
+	int out_arity;
+	cat_error* status;
+	int count;
+	std::atomic<int> next;
+	std::atomic<int> failed;
+};
+
+bool push_cat_value(const cat_value& v)
+{
+	switch (v.type)
+	{
+		case CAT_TYPE_INT: stk.push(v.as.i); return true;
+		case CAT_TYPE_BOOL: stk.push(v.as.i != 0); return true;
+		case CAT_TYPE_DOUBLE: stk.push(v.as.d); return true;
+		case CAT_TYPE_STRING: stk.push(cstring(v.as.s)); return true;
+		default: return false;
+	}
+}
+
+bool to_cat_value(object& o, cat_value& v)
+{
+	if (o.is<int>()) 
+	{
+		v.type = CAT_TYPE_INT;
+		v.as.i = o.to<int>();
+	}
+	else if (o.is<bool>()) 
+	{
+		v.type = CAT_TYPE_BOOL;
+		v.as.i = o.to<bool>() ? 1 : 0;
+	}
+	else if (o.is<double>()) 
+	{
+		v.type = CAT_TYPE_DOUBLE;
+		v.as.d = o.to<double>();
+	}
+	else if (o.is<cstring>()) 
+	{
+		v.type = CAT_TYPE_STRING;
+		v.as.s = o.to<cstring>().to_ptr();
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+cat_error batch_item(batch_job* job, int i)
+{
+	const cat_value* in = job->inputs + (size_t)i * job->in_arity;
+	for (int k=0; k < job->in_arity; ++k)
+		if (!push_cat_value(in[k]))
+			return CAT_ERR_INVALID_ARG;
+	cat_error err = invoke(job->fxn, NULL);
+	if (err != CAT_OK)
+		return err;
+	if (stk.count() != (size_t)job->out_arity)
+		return CAT_ERR_ARITY;
+	cat_value* out = job->outputs + (size_t)i * job->out_arity;
+	for (int k=0; k < job->out_arity; ++k)
+		if (!to_cat_value(stk[job->out_arity - 1 - k], out[k]))
+			return CAT_ERR_TYPE;
+	return CAT_OK;
+}
+
+void batch_worker(batch_job* job)
+{
+	// the calling thread may have values on its own stack
+	data_stack saved;
+	stk.swap(saved);
+	for (;;)
+	{
+		int first = job->next.fetch_add(batch_chunk);
+		if (first >= job->count)
+			break;
+		int last = first + batch_chunk < job->count ? first + batch_chunk : job->count;
+		for (int i=first; i < last; ++i)
+		{
+			cat_error err;
+			try 
+			{
+				err = batch_item(job, i);
+			}
+			catch (const std::bad_alloc&)
+			{
+				err = CAT_ERR_OUT_OF_MEMORY;
+			}
+			job->status[i] = err;
+			if (err != CAT_OK)
+				++job->failed;
+			// the stack is reused by the next item
+			stk.clear();
+		}
+	}
+	stk.swap(saved);
+}
+
+extern "C" {
+
+cat_context* cat_create(void)
+{
+	cat_init();
+	return new(std::nothrow) cat_context();
+}
+
+void cat_destroy(cat_context* ctx)
+{
+	delete ctx;
+}
+
+const char* cat_last_error(cat_context* ctx)
+{
+	return ctx == NULL ? "" : ctx->error;
+}
+
+const char* cat_error_name(cat_error err)
+{
+	switch (err)
+	{
+		case CAT_OK: return "ok";
+		case CAT_ERR_UNDERFLOW: return "stack underflow";
+		case CAT_ERR_TYPE: return "type error";
+		case CAT_ERR_UNKNOWN_DEF: return "unknown definition";
+		case CAT_ERR_FAILED: return "failed";
+		case CAT_ERR_OUT_OF_MEMORY: return "out of memory";
+		case CAT_ERR_INVALID_ARG: return "invalid argument";
+		case CAT_ERR_EXCEPTION: return "exception";
+		case CAT_ERR_ARITY: return "wrong number of results";
+	}
+	return "unknown error";
+}
+
+int cat_count(cat_context* ctx)
+{
+	return ctx == NULL ? 0 : (int)ctx->data.count();
+}
+
+cat_error cat_type_at(cat_context* ctx, int n, cat_type* out)
+{
+	if (ctx == NULL || out == NULL || n < 0) 
+		return CAT_ERR_INVALID_ARG;
+	if ((size_t)n >= ctx->data.count())
+		return set_error(ctx, CAT_ERR_UNDERFLOW, "index is past the bottom of the stack");
+	object& o = ctx->data[n];
+	if (o.is<int>()) 
+		*out = CAT_TYPE_INT;
+	else if (o.is<bool>()) 
+		*out = CAT_TYPE_BOOL;
+	else if (o.is<double>()) 
+		*out = CAT_TYPE_DOUBLE;
+	else if (o.is<cstring>()) 
+		*out = CAT_TYPE_STRING;
+	else if (is_list(o)) 
+		*out = CAT_TYPE_LIST;
+	else if (is_function(o)) 
+		*out = CAT_TYPE_FUNCTION;
+	else if (o.is_empty()) 
+		*out = CAT_TYPE_NONE;
+	else 
+		*out = CAT_TYPE_OTHER;
+	return CAT_OK;
+}
+
+cat_error cat_clear(cat_context* ctx)
+{
+	if (ctx == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	ctx->data.clear();
+	return CAT_OK;
+}
+
+cat_error cat_push_int(cat_context* ctx, int x)
+{
+	return push_value(ctx, x);
+}
+
+cat_error cat_push_bool(cat_context* ctx, int x)
+{
+	return push_value(ctx, x != 0);
+}
+
+cat_error cat_push_double(cat_context* ctx, double x)
+{
+	return push_value(ctx, x);
+}
+
+cat_error cat_push_string(cat_context* ctx, const char* x)
+{
+	if (ctx == NULL || x == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	char* s = (char*)malloc(strlen(x) + 1);
+	if (s == NULL)
+		return set_error(ctx, CAT_ERR_OUT_OF_MEMORY, "out of memory");
+	strcpy(s, x);
+	ctx->strings.push(s);
+	return push_value(ctx, cstring(s));
+}
+
+cat_error cat_push_nil(cat_context* ctx)
+{
+	return push_value(ctx, list());
+}
+
+cat_error cat_cons(cat_context* ctx)
+{
+	if (ctx == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	if (ctx->data.count() < 2)
+		return set_error(ctx, CAT_ERR_UNDERFLOW, "cons requires a list and a value");
+	if (!is_list(ctx->data[1]))
+	{
+		object::bad_object_cast e(ctx->data[1].type_info(), typeid(list));
+		return type_error(ctx, e);
+	}
+	ctx->data.swap(stk);
+	cat_error err = invoke(_cons, ctx);
+	ctx->data.swap(stk);
+	return err;
+}
+
+cat_error cat_uncons(cat_context* ctx)
+{
+	if (ctx == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	if (ctx->data.is_empty())
+		return set_error(ctx, CAT_ERR_UNDERFLOW, "uncons requires a list");
+	if (!is_list(ctx->data.top()))
+	{
+		object::bad_object_cast e(ctx->data.top().type_info(), typeid(list));
+		return type_error(ctx, e);
+	}
+	if (list_count(ctx->data.top()) == 0)
+		return set_error(ctx, CAT_ERR_UNDERFLOW, "uncons on an empty list");
+	ctx->data.swap(stk);
+	cat_error err = invoke(_uncons, ctx);
+	ctx->data.swap(stk);
+	return err;
+}
+
+cat_error cat_list_count(cat_context* ctx, int* out)
+{
+	if (ctx == NULL || out == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	if (ctx->data.is_empty())
+		return set_error(ctx, CAT_ERR_UNDERFLOW, "stack is empty");
+	if (!is_list(ctx->data.top()))
+	{
+		object::bad_object_cast e(ctx->data.top().type_info(), typeid(list));
+		return type_error(ctx, e);
+	}
+	*out = (int)list_count(ctx->data.top());
+	return CAT_OK;
+}
+
+cat_error cat_pop(cat_context* ctx)
+{
+	if (ctx == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	if (ctx->data.is_empty())
+		return set_error(ctx, CAT_ERR_UNDERFLOW, "stack is empty");
+	ctx->data.pop();
+	return CAT_OK;
+}
+
+cat_error cat_pop_int(cat_context* ctx, int* out)
+{
+	return pop_value(ctx, out);
+}
+
+cat_error cat_pop_bool(cat_context* ctx, int* out)
+{
+	bool b = false;
+	cat_error err = pop_value(ctx, &b);
+	if (err == CAT_OK)
+		*out = b ? 1 : 0;
+	return err;
+}
+
+cat_error cat_pop_double(cat_context* ctx, double* out)
+{
+	return pop_value(ctx, out);
+}
+
+cat_error cat_pop_string(cat_context* ctx, const char** out)
+{
+	cstring s;
+	cat_error err = pop_value(ctx, &s);
+	if (err == CAT_OK)
+		*out = s.to_ptr();
+	return err;
+}
+
+cat_error cat_find(const char* name, int* id)
+{
+	if (name == NULL || id == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	*id = find_def_id(name);
+	return *id < 0 ? CAT_ERR_UNKNOWN_DEF : CAT_OK;
+}
+
+cat_error cat_call(cat_context* ctx, const char* name)
+{
+	if (ctx == NULL || name == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	int id = find_def_id(name);
+	if (id < 0)
+		return set_error(ctx, CAT_ERR_UNKNOWN_DEF, name);
+	return cat_call_id(ctx, id);
+}
+
+cat_error cat_call_id(cat_context* ctx, int id)
+{
+	if (ctx == NULL) 
+		return CAT_ERR_INVALID_ARG;
+	fxn_ptr f = def_fxn(id);
+	if (f == NULL)
+		return set_error(ctx, CAT_ERR_UNKNOWN_DEF, "invalid definition id");
+	ctx->data.swap(stk);
+	memo_context* old_memo = memo_set_context(&ctx->memo);
+	cat_error err = invoke(f, ctx);
+	memo_set_context(old_memo);
+	ctx->data.swap(stk);
+	return err;
+}
+
+cat_error cat_set_memo(cat_context* ctx, int int_capacity, cat_memo_eviction eviction, int general_capacity)
+{
+	if (ctx == NULL || int_capacity < 0 || general_capacity < 0) 
+		return CAT_ERR_INVALID_ARG;
+	memo_eviction e;
+	switch (eviction)
+	{
+		case CAT_MEMO_REPLACE: e = memo_evict_replace; break;
+		case CAT_MEMO_LRU: e = memo_evict_lru; break;
+		case CAT_MEMO_NONE: e = memo_evict_none; break;
+		default: return CAT_ERR_INVALID_ARG;
+	}
+	try
+	{
+		memo_context* old_memo = memo_set_context(&ctx->memo);
+		memo_configure(int_capacity, e, general_capacity);
+		memo_set_context(old_memo);
+	}
+	catch (const std::bad_alloc&)
+	{
+		return set_error(ctx, CAT_ERR_OUT_OF_MEMORY, "out of memory");
+	}
+	return CAT_OK;
+}
+
+cat_error cat_batch_call(int id, const cat_value* inputs, int in_arity,
+	cat_value* outputs, int out_arity, cat_error* status, int count, 
+	int threads, cat_batch_stats* stats)
+{
+	if ((inputs == NULL && in_arity * count > 0) || (outputs == NULL && out_arity * count > 0) 
+		|| status == NULL || in_arity < 0 || out_arity < 0 || count < 0)
+		return CAT_ERR_INVALID_ARG;
+	batch_job job;
+	job.fxn = def_fxn(id);
+	if (job.fxn == NULL)
+		return CAT_ERR_UNKNOWN_DEF;
+	job.inputs = inputs;
+	job.in_arity = in_arity;
+	job.outputs = outputs;
+	job.out_arity = out_arity;
+	job.status = status;
+	job.count = count;
+	job.next = 0;
+	job.failed = 0;
+
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+	int max_threads = (count + batch_chunk - 1) / batch_chunk;
+	if (threads > max_threads)
+		threads = max_threads > 0 ? max_threads : 1;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// The calling thread is one of the workers. If a thread can't be started 
+	// the batch is shared by those which were, they all have to be joined 
+	// before job goes out of scope.
+	std::vector<std::thread> workers;
+	try 
+	{
+		workers.reserve(threads - 1);
+		for (int i=1; i < threads; ++i)
+			workers.push_back(std::thread(batch_worker, &job));
+	}
+	catch (const std::system_error&)
+	{
+	}
+	catch (const std::bad_alloc&)
+	{
+	}
+	batch_worker(&job);
+	for (size_t i=0; i < workers.size(); ++i)
+		workers[i].join();
+	threads = (int)workers.size() + 1;
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (stats != NULL)
+	{
+		stats->seconds = elapsed.count();
+		stats->items_failed = job.failed;
+		stats->items_ok = count - job.failed;
+		stats->threads = threads;
+	}
+	return CAT_OK;
+}
+
+} // extern "C"
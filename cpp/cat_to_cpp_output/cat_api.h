@@ -0,0 +1,134 @@
+/* Public domain Cat interpreter 
+ * http://www.cat-language.com
+ *
+ * C interface for hosting the compiled Cat runtime and library in-process. 
+ * Every function that can fail returns a cat_error code instead of printing 
+ * a message or throwing. The last error message of a context can be read 
+ * with cat_last_error.
+ *
+ * Each thread evaluates on its own data stack, so different contexts can 
+ * be used concurrently from different threads, but a single context must 
+ * only be used by one thread at a time.
+ */
+
+#ifndef CAT_API_H
+#define CAT_API_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cat_context cat_context;
+
+typedef enum cat_error 
+{
+	CAT_OK = 0,
+	CAT_ERR_UNDERFLOW,      /* not enough values on the stack */
+	CAT_ERR_TYPE,           /* a value had an unexpected type */
+	CAT_ERR_UNKNOWN_DEF,    /* no definition has the given name or id */
+	CAT_ERR_FAILED,         /* "halt" was called or a test failed */
+	CAT_ERR_OUT_OF_MEMORY,
+	CAT_ERR_INVALID_ARG,    /* a NULL context or output pointer */
+	CAT_ERR_EXCEPTION,      /* an uncaught "throw", or any other C++ exception */
+	CAT_ERR_ARITY           /* a definition left the wrong number of results */
+} cat_error;
+
+typedef enum cat_type 
+{
+	CAT_TYPE_NONE = 0,
+	CAT_TYPE_INT,
+	CAT_TYPE_BOOL,
+	CAT_TYPE_DOUBLE,
+	CAT_TYPE_STRING,
+	CAT_TYPE_LIST,
+	CAT_TYPE_FUNCTION,
+	CAT_TYPE_OTHER
+} cat_type;
+
+/* how a full memoization table makes room for a new entry */
+typedef enum cat_memo_eviction
+{
+	CAT_MEMO_REPLACE = 0,   /* direct mapped, replace the entry in the slot */
+	CAT_MEMO_LRU,           /* 4-way set associative, replace least recently used */
+	CAT_MEMO_NONE           /* 4-way set associative, drop the new entry */
+} cat_memo_eviction;
+
+/* a single input or output value of a batch call */
+typedef struct cat_value
+{
+	cat_type type;
+	union 
+	{
+		int i;          /* CAT_TYPE_INT and CAT_TYPE_BOOL */
+		double d;       /* CAT_TYPE_DOUBLE */
+		const char* s;  /* CAT_TYPE_STRING, not copied */
+	} as;
+} cat_value;
+
+typedef struct cat_batch_stats
+{
+	double seconds;     /* wall clock time of the whole batch */
+	int items_ok;
+	int items_failed;
+	int threads;        /* number of threads actually used */
+} cat_batch_stats;
+
+/* contexts */
+cat_context* cat_create(void);
+void cat_destroy(cat_context* ctx);
+const char* cat_last_error(cat_context* ctx);
+const char* cat_error_name(cat_error err);
+
+/* stack inspection, index 0 is the top of the stack */
+int cat_count(cat_context* ctx);
+cat_error cat_type_at(cat_context* ctx, int n, cat_type* out);
+cat_error cat_clear(cat_context* ctx);
+
+/* pushing values, strings are copied and live as long as the context */
+cat_error cat_push_int(cat_context* ctx, int x);
+cat_error cat_push_bool(cat_context* ctx, int x);
+cat_error cat_push_double(cat_context* ctx, double x);
+cat_error cat_push_string(cat_context* ctx, const char* x);
+
+/* lists: push an empty list, then cons values onto it */
+cat_error cat_push_nil(cat_context* ctx);
+cat_error cat_cons(cat_context* ctx);
+cat_error cat_uncons(cat_context* ctx);
+cat_error cat_list_count(cat_context* ctx, int* out);
+
+/* popping values */
+cat_error cat_pop(cat_context* ctx);
+cat_error cat_pop_int(cat_context* ctx, int* out);
+cat_error cat_pop_bool(cat_context* ctx, int* out);
+cat_error cat_pop_double(cat_context* ctx, double* out);
+cat_error cat_pop_string(cat_context* ctx, const char** out);
+
+/* calling definitions */
+cat_error cat_find(const char* name, int* id);
+cat_error cat_call(cat_context* ctx, const char* name);
+cat_error cat_call_id(cat_context* ctx, int id);
+
+/* Memoized definitions cache their results in tables owned by the context. 
+ * This sets their capacity in entries and clears them. The integer table 
+ * is used by definitions from one or two ints to an int. */
+cat_error cat_set_memo(cat_context* ctx, int int_capacity, 
+	cat_memo_eviction eviction, int general_capacity);
+
+/* Batch evaluation. Calls a definition once for each of "count" items. 
+ * Item i pushes inputs[i * in_arity] to inputs[i * in_arity + in_arity - 1]
+ * (the last one ends up on top), and must leave exactly out_arity ints, 
+ * bools, doubles or strings, which are written to outputs[i * out_arity] 
+ * onward in the same order. The result of each item is written to status[i].
+ * Items are split across "threads" threads (0 means one per core), each of 
+ * which reuses its own data stack, and fewer are used if threads can't be 
+ * started. Strings in inputs must outlive the call. Returns CAT_OK if the 
+ * batch ran, even if some items failed; "stats" may be NULL. */
+cat_error cat_batch_call(int id, const cat_value* inputs, int in_arity,
+	cat_value* outputs, int out_arity, cat_error* status, int count, 
+	int threads, cat_batch_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAT_API_H */
@@ -0,0 +1,109 @@
+// Public domain Cat interpreter
+// http://www.cat-language.com
+//
+// Tests of the C hosting interface, linked against the cat_api library.
+// Prints each failed check, and returns non-zero if any failed.
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "cat_api.h"
+
+int failures = 0;
+
+void check(bool b, const char* what)
+{
+	if (!b)
+	{
+		printf("failed: %s\n", what);
+		++failures;
+	}
+}
+
+// a definition which takes more values than the stack holds is an error,
+// and the stack is left as it was
+void test_underflow()
+{
+	cat_context* c = cat_create();
+	check(cat_call(c, "pop") == CAT_ERR_UNDERFLOW, "pop on an empty stack");
+	check(cat_count(c) == 0, "empty stack after underflow");
+	check(cat_call(c, "add_int") == CAT_ERR_UNDERFLOW, "add_int on an empty stack");
+	cat_push_int(c, 1);
+	check(cat_call(c, "swap") == CAT_ERR_UNDERFLOW, "swap with one value");
+	check(cat_count(c) == 1, "one value after underflow");
+	int n = 0;
+	check(cat_pop_int(c, &n) == CAT_OK && n == 1, "value kept after underflow");
+	check(cat_pop_int(c, &n) == CAT_ERR_UNDERFLOW, "pop_int on an empty stack");
+	cat_destroy(c);
+}
+
+void test_call()
+{
+	cat_context* c = cat_create();
+	cat_push_int(c, 2);
+	cat_push_int(c, 3);
+	check(cat_call(c, "add_int") == CAT_OK, "add_int");
+	int n = 0;
+	check(cat_pop_int(c, &n) == CAT_OK && n == 5, "result of add_int");
+	check(cat_call(c, "no_such_definition") == CAT_ERR_UNKNOWN_DEF, "unknown definition");
+	cat_destroy(c);
+}
+
+// the first calls build the definition index, which must happen once
+void find_add_int(int* id)
+{
+	cat_find("add_int", id);
+}
+
+void test_concurrent_init()
+{
+	std::vector<int> ids(8, -1);
+	std::vector<std::thread> threads;
+	for (size_t i=0; i < ids.size(); ++i)
+		threads.push_back(std::thread(find_add_int, &ids[i]));
+	for (size_t i=0; i < threads.size(); ++i)
+		threads[i].join();
+	for (size_t i=0; i < ids.size(); ++i)
+		check(ids[i] >= 0 && ids[i] == ids[0], "find from threads at once");
+}
+
+void test_batch()
+{
+	const int count = 1000;
+	std::vector<cat_value> inputs(count * 2);
+	std::vector<cat_value> outputs(count);
+	std::vector<cat_error> status(count);
+	for (int i=0; i < count; ++i)
+	{
+		inputs[i * 2].type = CAT_TYPE_INT;
+		inputs[i * 2].as.i = i;
+		inputs[i * 2 + 1].type = CAT_TYPE_INT;
+		inputs[i * 2 + 1].as.i = 1;
+	}
+	int id = -1;
+	cat_find("add_int", &id);
+	cat_batch_stats stats;
+	check(cat_batch_call(id, &inputs[0], 2, &outputs[0], 1, &status[0], count, 4, &stats) == CAT_OK, "batch add_int");
+	check(stats.items_ok == count && stats.threads >= 1, "batch stats");
+	for (int i=0; i < count; ++i)
+		check(status[i] == CAT_OK && outputs[i].as.i == i + 1, "batch result");
+
+	// every item underflows, and each is reported
+	cat_find("pop", &id);
+	check(cat_batch_call(id, NULL, 0, NULL, 0, &status[0], count, 4, &stats) == CAT_OK, "batch pop");
+	check(stats.items_failed == count, "batch underflows counted");
+	for (int i=0; i < count; ++i)
+		check(status[i] == CAT_ERR_UNDERFLOW, "batch underflow");
+}
+
+int main()
+{
+	// before anything else initializes the runtime
+	test_concurrent_init();
+	test_underflow();
+	test_call();
+	test_batch();
+	printf(failures == 0 ? "api tests passed\n" : "%d api tests failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -4,46 +4,147 @@
 
 #include "cat_lib.hpp"
 
+#include "cat_memo.hpp"
 #include "output.hpp"
+#include "cat_prefork.hpp"
+#include "cat_profile.hpp"
+
+// defined below
+void _memo__fib();
+
+// makes a list with a value of each kind, for the region test
+void make_region_values()
+{
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	call(_vec__nil);
+	push_literal(2);
+	call(_vec__push);
+	call(_cons);
+	call(_hash__list);
+	push_literal(3);
+	push_literal(4);
+	call(_hash__set);
+	call(_cons);
+	call(_nil);
+	push_literal(5);
+	call(_cons);
+	push_literal(6);
+	call(_cons);
+	push_literal(1);
+	call(_take);
+	call(_cons);
+	call(_nil);
+	push_literal(7);
+	call(_cons);
+	push_literal(8);
+	call(_snoc);
+	call(_cons);
+	push_literal(9);
+	call(_quote);
+	call(_cons);
+}
+
+// pushes two values then throws a third, for the exception test
+void push_and_throw()
+{
+	push_literal(2);
+	push_literal(3);
+	push_literal(7);
+	call(_throw);
+}
+
+// ( hash_list -> hash_list any ), for the missing key test
+void get_7()
+{
+	push_literal(7);
+	call(_hash__get);
+}
+
+// ( vector -> vector any ), for the vector index tests
+void vec_nth_5()
+{
+	push_literal(5);
+	call(_vec__nth);
+}
+
+// ( vector -> vector ), for the vector index tests
+void vec_slice_2_1()
+{
+	push_literal(2);
+	push_literal(1);
+	call(_vec__slice);
+}
+
+// ( k -> 2 ), escapes through k, so 3 is never pushed
+void escape_with_2()
+{
+	push_literal(2);
+	call(_swap);
+	call(_apply);
+	push_literal(3);
+}
+
+// ( k1 k2 -> ), escapes through the outer continuation k1
+void escape_outer()
+{
+	call(_pop);
+	call(_apply);
+	push_literal(3);
+}
+
+// ( k -> ), escapes from a nested callcc to the outer one
+void escape_nested()
+{
+	push_function(escape_outer);
+	call(_callcc);
+	push_literal(3);
+}
+
+// The unit tests check their results in every build, where cat_assert 
+// only does in debug builds.
+int test_failures = 0;
+#define test_check(T) if (!(T)) { printf("unit test failed, line %d: %s\n", __LINE__, #T); ++test_failures; }
 
 void unit_tests()
 {
-	cat_assert(stk.count() == 0);
+	test_check(stk.count() == 0);
 	push_literal(42);
-	cat_assert(stk.count() == 1);
-	cat_assert(stk[0] == 42);
+	test_check(stk.count() == 1);
+	test_check(stk[0] == 42);
 	call(_dup);
-	cat_assert(stk.count() == 2);
-	cat_assert(stk[1] == 42);
+	test_check(stk.count() == 2);
+	test_check(stk[1] == 42);
 	call(_pop);
-	cat_assert(stk.count() == 1);
+	test_check(stk.count() == 1);
 	call(_inc);
-	cat_assert(stk[0] == 43);
+	test_check(stk[0] == 43);
 	push_function(_inc);
-	cat_assert(stk.count() == 2);
+	test_check(stk.count() == 2);
 	call(_apply);
-	cat_assert(stk.count() == 1);
-	cat_assert(stk[0] == 44);
+	test_check(stk.count() == 1);
+	test_check(stk[0] == 44);
 	call(_dup);
 	call(_eq);
-	cat_assert(stk.count() == 1);
-	cat_assert(stk[0] == true);
+	test_check(stk.count() == 1);
+	test_check(stk[0] == true);
 	call(_pop);
 	push_literal(1);
 	push_literal(2);
 	call(_add__int);
-	cat_assert(stk.count() == 1);
+	test_check(stk.count() == 1);
 	push_literal(3);
 	call(_eq);
-	cat_assert(stk.count() == 1);
-	cat_assert(stk[0] == true);
+	test_check(stk.count() == 1);
+	test_check(stk[0] == true);
 	call(_pop);
 	
 	// empty list comparisons
 	call(_nil);
 	call(_nil);
 	call(_eq);
-	cat_assert(stk[0] == true);
+	test_check(stk[0] == true);
 	call(_pop);
 
 	// non-empty list comparison
@@ -54,7 +155,7 @@ void unit_tests()
 	push_literal(1);
 	call(_cons);
 	call(_eq);
-	cat_assert(stk[0] == true);
+	test_check(stk[0] == true);
 	call(_pop);
 
 	// composition tests
@@ -65,7 +166,20 @@ void unit_tests()
 	push_function(_add__int);
 	call(_compose);
 	call(_apply);
-	cat_assert(stk[0] == 7);
+	test_check(stk[0] == 7);
+	call(_pop);
+
+	// nested compositions are spliced into one array of steps
+	push_literal(0);
+	push_function(_inc);
+	for (int i=0; i < 4; ++i)
+	{
+		call(_dup);
+		call(_compose);
+	}
+	test_check(stk[0].to<composed_function>().nsteps == 16);
+	call(_apply);
+	test_check(stk[0] == 16);
 	call(_pop);
 
 	// while test
@@ -78,7 +192,7 @@ void unit_tests()
 	push_function(_lteq__int);
 	call(_compose);
 	call(_while);
-	cat_assert(stk[0] == 4);
+	test_check(stk[0] == 4);
 	call(_pop);
 
 	// whilene test
@@ -88,8 +202,525 @@ void unit_tests()
 	push_function(_dip);
 	call(_curry);
 	call(_whilene);
-	cat_assert(stk[0] == 0);
+	test_check(stk[0] == 0);
+	call(_pop);
+
+	// vector tests
+	call(_vec__nil);
+	for (int i=0; i < 1000; ++i)
+	{
+		push_literal(i);
+		call(_vec__push);
+	}
+	call(_dup);
+	push_literal(-1);
+	push_literal(500);
+	call(_vec__set__at);
+	push_literal(500);
+	call(_vec__nth);
+	test_check(stk[0] == -1);
+	call(_pop);
+	call(_swap);
+	push_literal(500);
+	call(_vec__nth);
+	test_check(stk[0] == 500);
+	call(_pop);
+	push_literal(499);
+	push_literal(503);
+	call(_vec__slice);
+	call(_vec__cat);
+	call(_vec__count);
+	test_check(stk[0] == 1004);
+	call(_pop);
+	push_literal(1003);
+	call(_vec__nth);
+	test_check(stk[0] == 502);
+	call(_pop);
+	call(_vec__to__list);
+	call(_list__to__vec);
+	push_literal(0);
+	call(_vec__nth);
+	test_check(stk[0] == 0);
+	call(_pop);
+	call(_pop);
+
+	// indexes out of range are thrown
+	call(_vec__nil);
+	push_function(_vec__pop);
+	push_function(_inc);
+	call(_try__catch);
+	test_check(stk[0] == 0);
+	call(_pop);
+	push_function(vec_nth_5);
+	push_function(_inc);
+	call(_try__catch);
+	test_check(stk[0] == 6);
+	call(_pop);
+	push_literal(1);
+	call(_vec__push);
+	push_literal(2);
+	call(_vec__push);
+	push_function(vec_slice_2_1);
+	push_function(_inc);
+	call(_try__catch);
+	test_check(stk[0] == 2);
+	call(_pop);
+	call(_vec__count);
+	test_check(stk[0] == 2);
 	call(_pop);
+	call(_pop);
+
+	// hash list tests
+	call(_hash__list);
+	for (int i=0; i < 1000; ++i)
+	{
+		push_literal(i * 2);
+		push_literal(i);
+		call(_hash__set);
+	}
+	call(_dup);
+	push_literal(-1);
+	push_literal(7);
+	call(_hash__set);
+	push_literal(7);
+	call(_hash__get);
+	test_check(stk[0] == -1);
+	call(_pop);
+	call(_swap);
+	push_literal(7);
+	call(_hash__get);
+	test_check(stk[0] == 14);
+	call(_pop);
+	push_literal(7);
+	call(_hash__remove);
+	// a missing key is thrown 
+	push_function(get_7);
+	push_function(_inc);
+	call(_try__catch);
+	test_check(stk[0] == 8);
+	call(_pop);
+	push_literal(7);
+	call(_hash__contains);
+	test_check(stk[0] == false);
+	call(_pop);
+	call(_hash__count);
+	test_check(stk[0] == 999);
+	call(_pop);
+	call(_pop);
+	call(_pop);
+
+	// list view tests, (1 2 3 4 5) with 1 at the head
+	call(_nil);
+	for (int i=5; i > 0; --i)
+	{
+		push_literal(i);
+		call(_cons);
+	}
+	call(_dup);
+	push_literal(2);
+	call(_split__at);
+	call(_swap);
+	call(_rev);
+	call(_cat);
+	push_literal(2);
+	call(_nth);
+	test_check(stk[0] == 3);
+	call(_pop);
+	// indexes out of range give an empty list
+	push_literal(5);
+	call(_nth);
+	call(_count);
+	test_check(stk[0] == 0);
+	call(_pop);
+	call(_pop);
+	push_literal(-1);
+	call(_nth);
+	call(_count);
+	test_check(stk[0] == 0);
+	call(_pop);
+	call(_pop);
+	call(_rev);
+	push_literal(6);
+	call(_cons);
+	call(_uncons);
+	call(_pop);
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+
+	// a view inside a quotation or a hash list value equals a list with the 
+	// same items, (1 2 3) 2 take quote == (1 2) quote
+	for (int j=0; j < 2; ++j)
+	{
+		call(_nil);
+		for (int i=(j == 0 ? 3 : 2); i > 0; --i)
+		{
+			push_literal(i);
+			call(_cons);
+		}
+		if (j == 0)
+		{
+			push_literal(2);
+			call(_take);
+		}
+		call(_quote);
+	}
+	test_check(stk[1].to<quoted_value>().value.is<list_view>());
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+	for (int j=0; j < 2; ++j)
+	{
+		call(_hash__list);
+		call(_nil);
+		for (int i=(j == 0 ? 3 : 2); i > 0; --i)
+		{
+			push_literal(i);
+			call(_cons);
+		}
+		if (j == 0)
+		{
+			push_literal(2);
+			call(_take);
+		}
+		push_literal(1);
+		call(_hash__set);
+	}
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+
+	// the last item of an empty list is an empty list
+	call(_nil);
+	call(_last);
+	call(_count);
+	test_check(stk[0] == 0);
+	call(_pop);
+	call(_pop);
+	call(_pop);
+
+	// deque tests, (1 2 3) snoc 4 snoc 5 unsnoc == (1 2 3 4) 5
+	call(_nil);
+	for (int i=3; i > 0; --i)
+	{
+		push_literal(i);
+		call(_cons);
+	}
+	push_literal(4);
+	call(_snoc);
+	push_literal(5);
+	call(_snoc);
+	call(_unsnoc);
+	test_check(stk[0] == 5);
+	call(_pop);
+	call(_uncons);
+	test_check(stk[0] == 1);
+	call(_cons);
+	call(_count);
+	test_check(stk[0] == 4);
+	call(_pop);
+	call(_last);
+	test_check(stk[0] == 4);
+	call(_pop);
+	call(_nil);
+	for (int i=4; i > 0; --i)
+	{
+		push_literal(i);
+		call(_cons);
+	}
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+
+	// region test, the values left on the stack are copied out of the region
+	push_function(make_region_values);
+	object f = stk.pull();
+	region_eval_proc proc(f);
+	run_in_region(proc);
+	test_check(region::local().used() == 0);
+	test_check(stk.count() == 1);
+	call(make_region_values);
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+
+	// distinct test, ((1) (2) (1) 3 3) has three distinct items, and the
+	// hashes kept by the lists are cleared when they are changed
+	call(_nil);
+	for (int i=0; i < 2; ++i)
+	{
+		push_literal(3);
+		call(_cons);
+	}
+	for (int i=1; i < 4; ++i)
+	{
+		call(_nil);
+		push_literal(i % 2 == 0 ? 2 : 1);
+		call(_cons);
+		call(_cons);
+	}
+	call(_distinct);
+	call(_count);
+	test_check(stk[0] == 3);
+	call(_pop);
+	call(_dup);
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+	call(_nil);
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	call(_cons);
+	call(_distinct);
+	call(_uncons);
+	push_literal(2);
+	call(_cons);
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	push_literal(2);
+	call(_cons);
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+	call(_pop);
+
+	// ((0.0)) equals ((-0.0)), distinct hashes the inner lists, which are 
+	// then compared by their hashes first
+	for (int i=0; i < 2; ++i)
+	{
+		call(_nil);
+		call(_nil);
+		push_literal(i == 0 ? 0.0 : -0.0);
+		call(_cons);
+		call(_cons);
+		call(_distinct);
+	}
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+
+	// NaN isn't equal to itself, alone or in a list
+	push_literal(std::numeric_limits<double>::quiet_NaN());
+	call(_dup);
+	call(_eq);
+	test_check(stk[0] == false);
+	call(_pop);
+	call(_nil);
+	push_literal(std::numeric_limits<double>::quiet_NaN());
+	call(_cons);
+	call(_dup);
+	call(_eq);
+	test_check(stk[0] == false);
+	call(_pop);
+
+	// hash consing test, equal lists and functions share one interned copy
+	for (int j=0; j < 2; ++j)
+	{
+		call(_nil);
+		push_literal(1);
+		call(_cons);
+		push_literal(2);
+		call(_quote);
+		call(_cons);
+		call(_intern);
+	}
+	test_check(stk[0].to<interned>().node == stk[1].to<interned>().node);
+	call(_dup);
+	push_literal(3);
+	call(_cons);
+	call(_count);
+	test_check(stk[0] == 3);
+	call(_pop);
+	call(_pop);
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+	cat_hash_consing = true;
+	push_literal(4);
+	push_function(_inc);
+	call(_curry);
+	push_function(_inc);
+	push_literal(4);
+	call(_rcurry);
+	test_check(stk[0].to<interned>().node == stk[1].to<interned>().node);
+	call(_pop);
+	call(_apply);
+	test_check(stk[0] == 5);
+	call(_pop);
+	cat_hash_consing = false;
+
+	// an interned function equals one which isn't interned, though its 
+	// items are interned as well, (1) quote intern == (1) quote
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	call(_quote);
+	call(_intern);
+	test_check(stk[0].is<interned>());
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	call(_quote);
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+	// the same whether quote and curry intern their results or not
+	for (int j=0; j < 2; ++j)
+	{
+		cat_hash_consing = j == 0;
+		call(_nil);
+		push_literal(1);
+		call(_cons);
+		push_function(_count);
+		call(_curry);
+	}
+	test_check(stk[1].is<interned>() && stk[0].is<closure>());
+	call(_eq);
+	test_check(stk[0] == true);
+	call(_pop);
+
+	// an interned key and an equal key which isn't interned are the same key
+	call(_hash__list);
+	push_literal(10);
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	call(_intern);
+	call(_hash__set);
+	push_literal(20);
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	call(_hash__set);
+	call(_hash__count);
+	test_check(stk[0] == 1);
+	call(_pop);
+	call(_nil);
+	push_literal(1);
+	call(_cons);
+	call(_intern);
+	call(_hash__get);
+	test_check(stk[0] == 20);
+	call(_pop);
+	call(_pop);
+
+	// closure tests, a closure holds up to three values and then the 
+	// values are quoted and composed
+	push_literal(1);
+	push_function(_add__int);
+	call(_curry);
+	test_check(stk[0].is<closure>());
+	push_literal(2);
+	call(_swap);
+	call(_apply);
+	test_check(stk[0] == 3);
+	call(_pop);
+	push_function(_add__int);
+	for (int i=0; i < 4; ++i)
+	{
+		push_literal(i);
+		call(_rcurry);
+	}
+	test_check(!stk[0].is<closure>());
+	push_function(_add__int);
+	call(_compose);
+	push_function(_add__int);
+	call(_compose);
+	call(_apply);
+	test_check(stk[0] == 6);
+	call(_pop);
+	push_literal(5);
+	call(_quote);
+	push_function(_inc);
+	call(_compose);
+	call(_apply);
+	test_check(stk[0] == 6);
+	call(_pop);
+
+	// exception tests, the stack is restored to its depth before the call
+	push_literal(1);
+	push_function(push_and_throw);
+	push_function(_inc);
+	call(_try__catch);
+	test_check(stk.count() == 2);
+	test_check(stk[0] == 8);
+	call(_pop);
+	push_function(_inc);
+	push_function(_pop);
+	call(_try__catch);
+	test_check(stk.count() == 1);
+	test_check(stk[0] == 2);
+	call(_pop);
+
+	// continuation tests
+	push_literal(1);
+	push_function(escape_with_2);
+	call(_callcc);
+	test_check(stk.count() == 2);
+	test_check(stk[0] == 2);
+	call(_pop);
+	push_function(escape_nested);
+	call(_callcc);
+	test_check(stk.count() == 1);
+	push_function(_pop);
+	call(_callcc);
+	test_check(stk.count() == 1);
+	call(_pop);
+
+	// statistics test, the counters are only kept with CAT_STATS
+	call(_stats);
+	push_literal("quotations");
+	call(_hash__get);
+	test_check(stk[0].is<int>());
+	call(_pop);
+	call(_pop);
+
+	// text evaluation, words which are too long and literals which don't 
+	// fit in an int are rejected
+	test_check(eval_line("-2147483648 2147483647"));
+	test_check(stk[0] == 2147483647 && stk[1] == -2147483647 - 1);
+	call(_pop);
+	call(_pop);
+	test_check(!eval_line("2147483648"));
+	test_check(!eval_line("99999999999999999999999"));
+	test_check(stk.count() == 0);
+	std::string long_word(300, 'a');
+	test_check(!eval_line(long_word.c_str()));
+
+	// memoization test
+	push_literal(26);
+	call(_memo__fib);
+	test_check(stk[0] == 196418);
+	call(_pop);
+
+	// a view is encoded like a list with the same items, and is left a view
+	call(_nil);
+	for (int i=3; i > 0; --i)
+	{
+		push_literal(i);
+		call(_cons);
+	}
+	call(_dup);
+	push_literal(2);
+	call(_take);
+	std::string view_key, list_key;
+	bool stable = true;
+	test_check(memo_encode(stk[0], view_key, stable));
+	test_check(stk[0].is<list_view>());
+	call(_pop);
+	call(_pop);
+	call(_nil);
+	for (int i=2; i > 0; --i)
+	{
+		push_literal(i);
+		call(_cons);
+	}
+	test_check(memo_encode(stk[0], list_key, stable));
+	test_check(view_key == list_key);
+	call(_pop);
+	test_check(stk.count() == 0);
 }
 
 /// Some custom stuff.
@@ -131,12 +762,145 @@ void _fib_test()
 	call(_fib);
 }
 
+// the same call inside of try_catch, which should take the same time
+void _fib_try_test()
+{
+	scoped_timer timer;
+	push_literal(26);
+	push_function(_fib);
+	push_function(_pop);
+	call(_try__catch);
+}
+
+// The same function as a memoized definition, as the translator outputs it for:
+//
+//   define memo_fib : (int -> int)
+//   {{
+//     memo:
+//       memory
+//   }}
+//   { dup 1 lteq_int [pop 1] [dec dup memo_fib swap dec memo_fib add_int] if }
+void _memo__fib_memo_body();
+
+void _memo__fib()
+{
+	memo_call_int(_memo__fib_memo_body, 0x992dc4fdae8a2ec7ULL, 1);
+}
+
+void _memo__fib_memo_body()
+{
+	call(_dup);
+	push_literal(1);
+	call(_lteq__int);
+	bool b = stk.pull().to<bool>();
+	if (b)
+	{
+		call(_pop);
+		push_literal(1);
+	}
+	else
+	{
+		call(_dec);
+		object tmp = stk.top();
+		call(_memo__fib);
+		stk.push(tmp);
+		call(_dec);
+		call(_memo__fib);
+		call(_add__int);
+	}
+}
+
+void _memo_fib_test()
+{
+	scoped_timer timer;
+	push_literal(26);
+	call(_memo__fib);
+}
+
+// The fib tests under the benchmark harness, an operation is a call of fib.
+size_t fib_calls(int n)
+{
+	return n <= 1 ? 1 : 1 + fib_calls(n - 1) + fib_calls(n - 2);
+}
+
+void bench_fib()
+{
+	push_literal(26);
+	call(_fib);
+	stk.clear();
+}
+
+void bench_fib_try()
+{
+	push_literal(26);
+	push_function(_fib);
+	push_function(_pop);
+	call(_try__catch);
+	stk.clear();
+}
+
+void run_benchmarks()
+{
+	bench_harness h;
+	h.run("fib 26", bench_fib, fib_calls(26));
+	h.run("fib 26 in try_catch", bench_fib_try, fib_calls(26));
+}
+
 int main(int argc, char* argv[])
 {
+#ifdef CAT_STATS
+	// written at exit and on SIGUSR1
+	stats_install();
+#endif
+
+#ifdef CAT_TRACE
+	// the trace is written at exit
+	if (getenv("CAT_TRACE_FILE") != NULL)
+		trace_start(getenv("CAT_TRACE_FILE"));
+#endif
+
+#if defined(CAT_PROFILE) && !defined(_WIN32)
+	// the folded stacks are written at exit
+	const char* profile_file = getenv("CAT_PROFILE_FILE");
+	profile_start(profile_file != NULL ? profile_file : "cat_profile.folded");
+#endif
+
+#ifndef _WIN32
+	// cat_cpp_output -serve [workers] [port]
+	if (argc > 1 && strcmp(argv[1], "-serve") == 0)
+	{
+		prefork_config cfg;
+		if (argc > 2) cfg.workers = atoi(argv[2]);
+		if (argc > 3) cfg.port = atoi(argv[3]);
+		return prefork_serve(cfg);
+	}
+#endif
+
+	// cat_cpp_output -test, returns non-zero if a unit test fails
+	if (argc > 1 && strcmp(argv[1], "-test") == 0)
+	{
+		unit_tests();
+		printf(test_failures == 0 ? "unit tests passed\n" : "%d unit tests failed\n", test_failures);
+		return test_failures == 0 ? 0 : 1;
+	}
+
+	// cat_cpp_output -bench
+	if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+	{
+		run_benchmarks();
+		return 0;
+	}
+
 	_fib_test();
 	print_stack();
+	stk.clear();
+	_fib_try_test();
+	print_stack();
+	stk.clear();
+	_memo_fib_test();
+	print_stack();
+	stk.clear();
 
-    //unit_tests();
 	try
 	{
 		//_run__tests();
@@ -2,25 +2,200 @@
 // by Christopher Diggins
 // http://www.cat-language.com
 
+#ifndef CAT_LIB_HPP
+#define CAT_LIB_HPP
+
 //#include <algorithm>
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Define CAT_STATS to keep runtime statistics (see cat_stats.hpp)
+//#define CAT_STATS
+
+#ifdef CAT_STATS
+#define OOTL_STATS
+#endif
 
 #include "..\ootl\ootl_object.hpp"
 #include "..\ootl\ootl_stack.hpp"
+#include "..\ootl\ootl_pvector.hpp"
+#include "..\ootl\ootl_hamt.hpp"
+#include "..\ootl\ootl_deque.hpp"
+#include "..\ootl\ootl_arena.hpp"
 #include "..\ootl\ootl_timer.hpp"
 
+#include "cat_trace.hpp"
+#include "cat_stats.hpp"
+
 using namespace ootl;
 
 //////////////////////////////////////////////////////////////////////////////
 // global data
 
-stack<object> stk;
+// Values are always constructed before they are read, so the buffers of the 
+// stack and of lists aren't zero filled. Big buffers use huge pages.
+struct cat_stack_policy : mapped_vlist_policy
+{
+	static const bool zero_fill = false;
+};
+
+// Lists are values, so like other values they are allocated from the 
+// thread's region while it is enabled. The data stack outlives evaluations 
+// and never is.
+typedef region_vlist_policy<cat_stack_policy> cat_list_policy;
+
+typedef stack<object, cat_stack_policy> data_stack;
+
+// each thread evaluates on its own data stack
+thread_local data_stack stk;
 
 //////////////////////////////////////////////////////////////////////////////
 // typedefs 
 
 typedef void(*fxn_ptr)();
-typedef stack<object> list;
+typedef stack<object, cat_list_policy> list_stack;
+typedef pvector<object> vector;
+
+// a list which has been used from both ends, the front is the head, and 
+// the front and back are list_stacks
+typedef deque<object, cat_list_policy> list_deque;
+
+// hashes the structure of values, so equal values have equal hashes 
+u8 hash_object(const object& o);
+
+// adds the hash of an item to the hash of a list
+u8 hash_item(u8 h, const object& o)
+{
+	u8 x = hash_object(o);
+	return fnv_hash(reinterpret_cast<const char*>(&x), sizeof(x), h);
+}
+
+// A list caches the structural hash of its items. It is computed when it 
+// is first needed, and cleared by the member functions which can change an 
+// item, including the non-const foreach. The stack is a private base, so 
+// those are the only way to change the items. Code which only reads a list 
+// should take a const list&, which keeps the hash. A reference to an item, 
+// from top, operator[] or an iterator, must not be used to change it after 
+// the hash has been computed again, since that change isn't noticed.
+struct list : private list_stack
+{
+	typedef list_stack::value_type value_type;
+	typedef list_stack::iterator iterator;
+	typedef list_stack::const_iterator const_iterator;
+
+	list() 
+		: mHash(0), mHashed(false)
+	{ }
+	list(const list& x) 
+		: list_stack(x), mHash(x.mHash), mHashed(x.mHashed)
+	{ }
+
+	// the same as hash_object for the list
+	u8 hash() const
+	{
+		if (!mHashed)
+		{
+			u8 h = fnv_hash("(", 1);
+			for (size_t i=0; i < count(); ++i)
+				h = hash_item(h, (*this)[i]);
+			mHash = h;
+			mHashed = true;
+		}
+		return mHash;
+	}
+	bool has_hash() const
+	{
+		return mHashed;
+	}
+
+	using list_stack::count;
+	using list_stack::copy_out;
+	using list_stack::copy_to_array;
+
+	bool is_empty() const { return count() == 0; }
+	template<typename Procedure>
+	bool compare_ranges(const list& x, Procedure& proc) const { return list_stack::compare_ranges(x, proc); }
+	bool operator==(const list& x) const { return list_stack::operator==(x); }
+
+	using list_stack::top;
+	using list_stack::operator[];
+	using list_stack::begin;
+	using list_stack::end;
+
+	object& top() { mHashed = false; return list_stack::top(); }
+	object& operator[](size_t n) { mHashed = false; return list_stack::operator[](n); }
+	iterator begin() { mHashed = false; return list_stack::begin(); }
+	iterator end() { mHashed = false; return list_stack::end(); }
+	void set_at(size_t n, const object& x) { mHashed = false; list_stack::set_at(n, x); }
+	void push(const object& x) { mHashed = false; list_stack::push(x); }
+	void push() { mHashed = false; list_stack::push(); }
+	void push_nocreate() { mHashed = false; list_stack::push_nocreate(); }
+	void pop() { mHashed = false; list_stack::pop(); }
+	void pop_nodestroy() { mHashed = false; list_stack::pop_nodestroy(); }
+	object pull() { mHashed = false; return list_stack::pull(); }
+	void clear() { mHashed = false; list_stack::clear(); }
+	void clear_nodestroy() { mHashed = false; list_stack::clear_nodestroy(); }
+	void push_n(size_t n, const object& x = object()) { mHashed = false; list_stack::push_n(n, x); }
+	template<typename Iter>
+	void append_range(Iter first, Iter last) { mHashed = false; list_stack::append_range(first, last); }
+	void append(const list_stack& x) { mHashed = false; list_stack::append(x); }
+	void append(const list& x) { mHashed = false; list_stack::append(x); }
+	void pop_n(size_t n) { mHashed = false; list_stack::pop_n(n); }
+	void pop_n_nodestroy(size_t n) { mHashed = false; list_stack::pop_n_nodestroy(n); }
+	void grow(size_t n = 1, const object& x = object()) { mHashed = false; list_stack::grow(n, x); }
+	void shrink(size_t n = 1) { mHashed = false; list_stack::shrink(n); }
+	void resize(size_t n, const object& x = object()) { mHashed = false; list_stack::resize(n, x); }
+	void swap(list_stack& x) { mHashed = false; list_stack::swap(x); }
+	template<typename Procedure>
+	void foreach(Procedure& proc) { mHashed = false; list_stack::foreach(proc); }
+	template<typename Procedure>
+	void foreach(Procedure& proc) const { list_stack::foreach(proc); }
+	void swap(list& x) 
+	{ 
+		list_stack::swap(x); 
+		std::swap(mHash, x.mHash);
+		std::swap(mHashed, x.mHashed);
+	}
+
+private:
+
+	mutable u8 mHash;
+	mutable bool mHashed;
+};
+
+struct object_hasher
+{
+	u4 operator()(const object& o) const 
+	{
+		u8 h = hash_object(o);
+		return static_cast<u4>(h ^ (h >> 32));
+	}
+};
+
+bool values_equal(const object& x, const object& y);
+bool items_equal(const object* x, const object* y, size_t n);
+
+// Keys and values are compared structurally, like they are hashed, so an 
+// interned key finds the entry of an equal key which isn't interned, and a 
+// view equals a list with the same items.
+struct object_equal
+{
+	bool operator()(const object& x, const object& y) const
+	{
+		return values_equal(x, y);
+	}
+};
+
+typedef hamt<object, object, object_hasher, object_equal> hash_list;
 
 //////////////////////////////////////////////////////////////////////////////
 // forward declarations
@@ -33,13 +208,104 @@ void _eval(object& o);
 // Uncomment this line to have a verbose execution for debugging purposes 
 //#define VERBOSE
 
+// Define CAT_PROFILE to keep a shadow stack of the functions being called, 
+// which the sampling profiler reads (see cat_profile.hpp)
+//#define CAT_PROFILE
+
+// Define CAT_TRACE to record calls while tracing is started (see 
+// cat_trace.hpp and trace_start)
+//#define CAT_TRACE
+
 // This is a standard call
 #ifdef VERBOSE
 #define call(FXN) printf("calling %s\n", #FXN); FXN(); print_stack(); /* */
+#elif defined(CAT_PROFILE) || defined(CAT_TRACE) || defined(CAT_STATS)
+#define call(FXN) { call_frame cf_(FXN); FXN(); } /* */
 #else 
 #define call(FXN) FXN(); /* */
 #endif
 
+// The functions being called on this thread, outermost first. It has no 
+// constructor, so like the region it is zero initialized, and it can be 
+// read from a signal handler.
+struct profile_stack
+{
+	static const size_t max_depth = 256;
+
+	static profile_stack& local()
+	{
+		static thread_local profile_stack s;
+		return s;
+	}
+
+	fxn_ptr frames[max_depth];
+	// frames deeper than max_depth are counted but not kept
+	size_t depth;
+};
+
+struct profile_frame
+{
+	profile_frame(fxn_ptr f)
+		: s(profile_stack::local())
+	{
+		if (s.depth < profile_stack::max_depth)
+			s.frames[s.depth] = f;
+		// the frame is written before a signal can see it
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		++s.depth;
+	}
+	~profile_frame()
+	{
+		--s.depth;
+	}
+	profile_stack& s;
+};
+
+// records entering or leaving f, defined below
+void trace_call(fxn_ptr f, unsigned char event);
+
+// wraps a call when profiling, tracing or keeping statistics
+struct call_frame
+{
+	call_frame(fxn_ptr f)
+#ifdef CAT_PROFILE
+		: pf(f)
+#endif
+	{
+		// only used when profiling or tracing
+		(void)f;
+#ifdef CAT_TRACE
+		fxn = f;
+		traced = cat_tracing.load(std::memory_order_relaxed);
+		if (traced)
+			trace_call(f, trace_enter);
+#endif
+#ifdef CAT_STATS
+		stats_depth(stk.count());
+#endif
+	}
+	~call_frame()
+	{
+#ifdef CAT_TRACE
+		// an exit is only written if the enter was, so that tracing which 
+		// starts during the call doesn't leave an exit without an enter
+		if (traced)
+			trace_call(fxn, trace_exit);
+#endif
+	}
+#ifdef CAT_PROFILE
+	profile_frame pf;
+#endif
+#ifdef CAT_TRACE
+	fxn_ptr fxn;
+	bool traced;
+#endif
+};
+
+// stands for a quotation in the shadow stack
+void profile_quotation() 
+{ }
+
 #ifdef DEBUG
 void cat_assert(bool b)
 {
@@ -50,6 +316,37 @@ void cat_assert(bool b)
 #define cat_assert(T) ;
 #endif
 
+//////////////////////////////////////////////////////////////////////////////
+// error reporting
+
+void report_error(const char* msg)
+{
+	perror(msg);
+}
+
+// Called when a test fails or "halt" is executed. Hosts can replace this 
+// to turn failures into error codes or exceptions. Set per thread.
+thread_local void (*cat_fail)(const char* msg) = report_error;
+
+// The message of cat_fail when a primitive finds too few values on the
+// stack, which hosts can compare against to report an underflow.
+const char* const cat_underflow_msg = "stack underflow";
+
+// Checks that a primitive has the N values it takes. If not it calls
+// cat_fail and returns, so the stack is left alone rather than read past
+// its bottom. Hosts make cat_fail throw, so they never see the return.
+#define cat_require(N) do { if (stk.count() < (N)) { cat_fail(cat_underflow_msg); return; } } while (0)
+
+// Thrown by "throw" and caught by "try_catch". Exceptions which aren't
+// thrown cost nothing, the compiler's tables are only used when unwinding.
+struct cat_exception
+{
+	cat_exception(const object& x)
+		: data(x)
+	{ }
+	object data;
+};
+
 //////////////////////////////////////////////////////////////////////////////
 // function types
 
@@ -82,7 +379,7 @@ struct quoted_value
 	}
 	bool operator==(const quoted_value& x) const 
 	{
-		return value == x.value;
+		return values_equal(value, x.value);
 	}
 	// can only be called once. This is critical 
 	// for fast "quote apply" instructions. Consider "1000000 n quote" ... "apply"
@@ -97,388 +394,2635 @@ struct quoted_value
 	object value;
 };
 
+// A composition is flattened into an array of steps, each of which either 
+// calls a function or pushes the next of an array of values. Compositions, 
+// closures and quotations are spliced in when they are composed, so 
+// evaluating it is a single loop however it was built. Both arrays are 
+// contiguous, and grow by doubling as functions are composed with it.
 struct composed_function
 {
+	composed_function()
+		: steps(NULL), values(NULL), nsteps(0), nvalues(0), step_capacity(0), value_capacity(0), 
+		  hash(0), hashed(false), invalid(false)
+	{ }
 	composed_function(const composed_function& cf)
-		: fxns(cf.fxns)
+		: steps(NULL), values(NULL), nsteps(0), nvalues(0), step_capacity(0), value_capacity(0), 
+		  hash(cf.hash), hashed(cf.hashed), invalid(false)
 	{ 
-		invalid = false;
+		reserve_steps(cf.nsteps);
+		reserve_values(cf.nvalues);
+		if (cf.nsteps > 0)
+			memcpy(steps, cf.steps, cf.nsteps * sizeof(fxn_ptr));
+		nsteps = cf.nsteps;
+		for (; nvalues < cf.nvalues; ++nvalues)
+			new(values + nvalues) object(cf.values[nvalues]);
 	}
 	composed_function(object& first, object& second)
+		: steps(NULL), values(NULL), nsteps(0), nvalues(0), step_capacity(0), value_capacity(0), 
+		  hash(0), hashed(false), invalid(false)
 	{
-		invalid = false;
-		fxns.push_nocreate();
-		first.move_to(fxns.top());
-		fxns.push_nocreate();
-		second.move_to(fxns.top());
+		compose_with(first);
+		compose_with(second);
+	}
+	~composed_function()
+	{
+		destroy_items(values, nvalues);
+		region_deallocate(steps);
+		region_deallocate(values);
+	}
+	// appends the steps of o, which is consumed 
+	void compose_with(object& o);
+
+	void push_step(fxn_ptr f)
+	{
+		if (nsteps == step_capacity)
+			reserve_steps(nsteps == 0 ? 4 : nsteps * 2);
+		steps[nsteps++] = f;
+		hashed = false;
 	}
-	void compose_with(object& o)
+	// adds a step which pushes o, o is moved
+	void push_value(object& o)
 	{
-		// TODO: check that o is a function. 
-		fxns.push_nocreate();
-		o.move_to(fxns.top());
+		push_step(NULL);
+		if (nvalues == value_capacity)
+			reserve_values(nvalues == 0 ? 4 : nvalues * 2);
+		o.move_to(values[nvalues++]);
 	}
-	// can only be called once 
+	// can only be called once, the values are moved onto the stack
 	void eval()
 	{
 		cat_assert(!invalid);
-		fxns.foreach(_eval);
 		invalid = true;
+		object* v = values;
+		for (size_t i=0; i < nsteps; ++i)
+		{
+			if (steps[i] != NULL)
+			{
+				call(steps[i]);
+			}
+			else
+			{
+				stk.push_nocreate();
+				(v++)->move_to(stk.top());
+			}
+		}
 	}
 	bool operator==(const composed_function& x) const 
 	{
-		return fxns == x.fxns;
+		if (nsteps != x.nsteps || nvalues != x.nvalues)
+			return false;
+		if (nsteps > 0 && memcmp(steps, x.steps, nsteps * sizeof(fxn_ptr)) != 0)
+			return false;
+		return items_equal(values, x.values, nvalues);
 	}
+
+	fxn_ptr* steps;
+	object* values;
+	size_t nsteps;
+	size_t nvalues;
+	size_t step_capacity;
+	size_t value_capacity;
+	// cached by hash_object, and cleared when a step is added
+	mutable u8 hash;
+	mutable bool hashed;
 	bool invalid;
-	list fxns;
-};
 
-//////////////////////////////////////////////////////////////////////////////
-// stack display functions
+private:
 
-void print_object(object& o);
+	void reserve_steps(size_t n)
+	{
+		if (n <= step_capacity)
+			return;
+		fxn_ptr* p = (fxn_ptr*)region_allocate(n * sizeof(fxn_ptr));
+		if (nsteps > 0)
+			memcpy(p, steps, nsteps * sizeof(fxn_ptr));
+		region_deallocate(steps);
+		steps = p;
+		step_capacity = n;
+	}
+	// Objects don't refer to their own address, so they are relocated with
+	// memcpy, the casts say that this is intended.
+	void reserve_values(size_t n)
+	{
+		if (n <= value_capacity)
+			return;
+		object* p = (object*)region_allocate(n * sizeof(object));
+		if (nvalues > 0)
+			memcpy((void*)p, (const void*)values, nvalues * sizeof(object));
+		region_deallocate(values);
+		values = p;
+		value_capacity = n;
+	}
 
-void print_list(list& l)
-{
-	printf("(");
-	l.foreach(print_object);
-	printf(") ");
-}
+	// hide the assignment operator
+	void operator=(const composed_function&) { }
+};
 
-void print_object(object& o)
+// A function with values bound to it, made by curry. Evaluating it pushes 
+// the values, the first one first, and then calls the function directly. 
+// The values are held inline, so a closure is a single allocation.
+struct closure
 {
-	if (o.is<int>())
-	{			
-		printf("%d ", o.to<int>());
-	}
-	else if (o.is<bool>())
-	{			
-		if (o.to<bool>())
-			printf("true ");
-		else 
-			printf("false ");
-	}
-	else if (o.is<list>())
+	static const size_t max_values = 3;
+
+	closure(fxn_ptr f)
+		: fxn(f), count(0)
+	{ }
+	closure(const closure& x)
+		: fxn(x.fxn), count(x.count)
 	{
-		print_list(o.to<list>());
+		for (size_t i=0; i < count; ++i)
+			values[i] = x.values[i];
 	}
-	else if (o.is<quoted_value>())
+	bool is_full() const
 	{
-		printf("[");
-		print_object(o.to<quoted_value>().value);
-		printf("] ");
+		return count == max_values;
 	}
-	else if (o.is<composed_function>())
+	// binds o in front of the values already bound, o is moved 
+	void bind(object& o)
 	{
-		printf("{");
-		print_list(o.to<composed_function>().fxns);
-		printf("} ");
+		cat_assert(!is_full());
+		for (size_t i=count; i > 0; --i)
+			values[i - 1].move_to(values[i]);
+		o.move_to(values[0]);
+		++count;
 	}
-	else if (o.is<prim_function>())
+	// can only be called once, the values are moved onto the stack
+	void eval()
 	{
-		printf("fxn ");
+		for (size_t i=0; i < count; ++i)
+		{
+			stk.push_nocreate();
+			values[i].move_to(stk.top());
+		}
+		count = 0;
+		call(fxn);
 	}
-	else if (o.is_empty())
+	bool operator==(const closure& x) const 
 	{
-		printf("invalid object!");
-		cat_assert(false);
+		if (fxn != x.fxn || count != x.count)
+			return false;
+		return items_equal(values, x.values, count);
 	}
-	else
+	fxn_ptr fxn;
+	size_t count;
+	object values[max_values];
+};
+
+// Turns a primitive function into a closure. Returns false if f is neither,
+// or if it is a closure which can't have another value bound to it.
+bool as_closure(object& f)
+{
+	if (f.is<prim_function>())
 	{
-		cat_assert(false);
+		fxn_ptr p = f.to<prim_function>().fxn;
+		f = closure(p);
+		return true;
 	}
+	return f.is<closure>() && !f.to<closure>().is_full();
 }
 
-void print_stack()
-{		
-	// For debugging:
-	stk.foreach(print_object);
-	puts("");
-}
+// The ids of the continuations whose callcc hasn't returned, innermost last
+thread_local std::vector<size_t> live_continuations;
+thread_local size_t next_continuation_id = 0;
+
+// thrown by a continuation, and caught by the callcc which made it
+struct continuation_jump
+{
+	continuation_jump(size_t n)
+		: id(n)
+	{ }
+	size_t id;
+};
+
+// An escape continuation, made by callcc. Calling it unwinds to its callcc,
+// which returns with the stack as it is. It is only an id, so capturing it 
+// copies nothing. The rest of a computation is on the native call stack, so
+// a continuation can't be resumed once its callcc has returned.
+struct continuation
+{
+	continuation(size_t n)
+		: id(n)
+	{ }
+	bool operator==(const continuation& x) const 
+	{
+		return id == x.id;
+	}
+	void eval() const
+	{
+		for (size_t i=live_continuations.size(); i > 0; --i)
+			if (live_continuations[i - 1] == id)
+				throw continuation_jump(id);
+		cat_fail("continuation called after its callcc returned");
+	}
+	size_t id;
+};
 
 //////////////////////////////////////////////////////////////////////////////
-// Implementation functions
+// interned values
+//
+// With hash consing, equal lists and functions share a single immutable 
+// copy, found through a table of weak references keyed by a structural hash 
+// (see "hash consing" below). Two interned values are equal only if they are 
+// the same copy. An interned value and one which isn't are compared 
+// structurally, at every depth, since interning a function interns the 
+// items it holds as well. Interned values are never modified: primitives which modify 
+// a list copy it first, and evaluating an interned function evaluates a copy.
 
-// note: a function object can only ever be evaluated once.	
-// this is because a quoted_value will literally move its value into 
-// the stack invalidating itself
-void _eval(object& o)
+// When set, quote and compose intern the functions they make. The intern 
+// primitive interns a value whether this is set or not.
+bool cat_hash_consing = false;
+
+// Set when an interned value is made while the thread's region is enabled. 
+// The values of a region aren't destroyed, so the references they hold 
+// would never be released (see discard_stack).
+thread_local bool interned_in_region = false;
+
+struct interned_node
 {
-	if (o.is<quoted_value>())
+	interned_node(object& o, u8 h)
+		: hash(h)
 	{
-		o.to<quoted_value>().eval();
+		o.move_to(value);
+	}
+	object value;
+	u8 hash;
+};
+
+typedef std::shared_ptr<const interned_node> interned_ptr;
+
+struct interned
+{
+	interned(const interned_ptr& p)
+		: node(p)
+	{ 
+		if (region::local().is_enabled())
+			interned_in_region = true;
+	}
+	interned(const interned& x)
+		: node(x.node)
+	{ 
+		if (region::local().is_enabled())
+			interned_in_region = true;
+	}
+	bool operator==(const interned& x) const 
+	{
+		return node == x.node;
+	}
+	interned_ptr node;
+};
+
+bool intern(object& o);
+void eval_top();
+
+void composed_function::compose_with(object& o)
+{
+	if (o.is<prim_function>())
+	{
+		push_step(o.to<prim_function>().fxn);
+	}
+	else if (o.is<quoted_value>())
+	{
+		push_value(o.to<quoted_value>().value);
+	}
+	else if (o.is<closure>())
+	{
+		closure& c = o.to<closure>();
+		for (size_t i=0; i < c.count; ++i)
+			push_value(c.values[i]);
+		c.count = 0;
+		push_step(c.fxn);
 	}
 	else if (o.is<composed_function>())
 	{
-		o.to<composed_function>().eval();
+		composed_function& cf = o.to<composed_function>();
+		object* v = cf.values;
+		for (size_t i=0; i < cf.nsteps; ++i)
+		{
+			if (cf.steps[i] != NULL)
+				push_step(cf.steps[i]);
+			else
+				push_value(*v++);
+		}
 	}
-	else if (o.is<prim_function>())
+	else if (o.is<interned>())
+	{
+		// the interned copy is shared, so a copy of it is spliced in
+		object tmp(o.to<interned>().node->value);
+		compose_with(tmp);
+	}
+	else if (o.is<continuation>())
 	{
-		o.to<prim_function>().fxn();
+		push_value(o);
+		push_step(eval_top);
 	}
 	else
 	{
-		// Not a function. Note that you could simply do nothing thus 
-		// echoing the value on the stack. 
-		// This would give you different langauge semantics.
+		// not a function
 		cat_assert(false);
 	}
-	o.release_nodestroy();
+	o.release();
 }
 
-// note: this is not a reference, so the object doesn't get invalidated
-void _eval_copy(object o)
-{
-	_eval(o);
-}
+//////////////////////////////////////////////////////////////////////////////
+// list views
+//
+// take, drop, split_at, cat, rev and flatten return views which refer to 
+// the lists they were made from instead of copying them. View nodes are 
+// immutable and shared. A view is turned back into a list (materialized)
+// only by primitives which modify a list in place, such as cons. 
+//
+// As with lists, index 0 is the head of a view (the top of the stack).
 
-void push_function(fxn_ptr fp)
+struct list_view_node;
+typedef std::shared_ptr<const list_view_node> list_view_ptr;
+typedef std::shared_ptr<list_view_node> new_view_ptr;
+
+struct list_view_node
 {
-	stk.push(prim_function(fp));
-#ifdef VERBOSE
-	print_stack();
-#endif
-}
+	enum kind_type { leaf_kind, slice_kind, concat_kind, reverse_kind };
 
-template<typename T>
-void push_literal(const T& x)
+	list_view_node(kind_type k, size_t n, int d)
+		: kind(k), first(0), cnt(n), depth(d)
+	{ }
+
+	kind_type kind;
+	// the items of a leaf
+	list items;
+	// the viewed node, and the second node of a concatenation
+	list_view_ptr left;
+	list_view_ptr right;
+	// the index of the first item of a slice
+	size_t first;
+	size_t cnt;
+	int depth;
+};
+
+// Views deeper than this are materialized, which keeps indexing cheap
+const int max_view_depth = 32;
+
+// nodes are values, so they come from the region while it is enabled
+new_view_ptr new_view_node(list_view_node::kind_type k, size_t n, int d)
 {
-	stk.push(x);
-#ifdef VERBOSE
-	print_stack();
-#endif
+	return std::allocate_shared<list_view_node>(region_allocator<list_view_node>(), k, n, d);
 }
 
-//////////////////////////////////////////////////////////////////////////////
-// primitive functions 
+struct list_view
+{
+	list_view(const list_view_ptr& p)
+		: node(p)
+	{ }
+	bool operator==(const list_view& x) const;
+	list_view_ptr node;
+};
 
-// Could be bootstrapped, but it would be very slow and complicated. It would require
-// using the Y or M combinator, and would be of only mild theoretical interest
-void _while()
+const object& view_at(const list_view_node* p, size_t n)
 {
-	object cond;
-	object body;
-	stk.top().move_to(cond);
-	stk.pop_nodestroy();
-	stk.top().move_to(body);
-	stk.pop_nodestroy();
-	
-	// force a copy of the function: otherwise it would get invalidated
-	_eval_copy(cond);
-	while (stk.pull().to<bool>())
+	while (true)
 	{
-		_eval_copy(body);
-		_eval_copy(cond);
+		switch (p->kind)
+		{
+		case list_view_node::leaf_kind: 
+			return p->items[n];
+		case list_view_node::slice_kind: 
+			n += p->first;
+			p = p->left.get();
+			break;
+		case list_view_node::reverse_kind:
+			n = p->cnt - 1 - n;
+			p = p->left.get();
+			break;
+		default:
+			if (n < p->left->cnt) 
+			{
+				p = p->left.get();
+			}
+			else 
+			{
+				n -= p->left->cnt;
+				p = p->right.get();
+			}
+			break;
+		}
 	}
 }
 
-// Could also be bootstrapped, but would be ridiculously slow
-void _empty()
+// Calls proc with "n" items of a view starting at "first", from the last 
+// to the first if "backwards" is true.
+template<typename Procedure>
+void view_foreach(const list_view_node* p, size_t first, size_t n, bool backwards, Procedure& proc)
 {
-	stk.push(stk.top().to<list>().is_empty());
+	if (n == 0)
+		return;
+	switch (p->kind)
+	{
+	case list_view_node::leaf_kind: 
+		if (backwards)
+			for (size_t i=first + n; i > first; --i)
+				proc(p->items[i - 1]);
+		else
+			for (size_t i=first; i < first + n; ++i)
+				proc(p->items[i]);
+		break;
+	case list_view_node::slice_kind: 
+		view_foreach(p->left.get(), p->first + first, n, backwards, proc);
+		break;
+	case list_view_node::reverse_kind:
+		view_foreach(p->left.get(), p->cnt - first - n, n, !backwards, proc);
+		break;
+	default: 
+		{
+			size_t mid = p->left->cnt;
+			size_t nleft = first < mid ? (first + n < mid ? n : mid - first) : 0;
+			size_t nright = n - nleft;
+			size_t rfirst = first < mid ? 0 : first - mid;
+			if (backwards)
+				view_foreach(p->right.get(), rfirst, nright, true, proc);
+			view_foreach(p->left.get(), first, nleft, backwards, proc);
+			if (!backwards)
+				view_foreach(p->right.get(), rfirst, nright, false, proc);
+		}
+		break;
+	}
 }
 
-void _add__int()
+struct push_proc
 {
-	cat_assert(stk.count() >= 2);
-	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m + n);
+	push_proc(list& x)
+		: lst(x)
+	{ }
+	void operator()(const object& o)
+	{
+		lst.push(o);
+	}
+	list& lst;
+};
+
+void materialize(const list_view_node* p, list& out)
+{
+	// pushing from the last item leaves the first item on top
+	push_proc proc(out);
+	view_foreach(p, 0, p->cnt, true, proc);
 }
 
-void _mul__int()
+// Turns a list into a view, the list is moved into the view, not copied.
+list_view_ptr make_leaf(list& lst)
 {
-	cat_assert(stk.count() >= 2);
-	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m * n);
+	new_view_ptr p = new_view_node(list_view_node::leaf_kind, lst.count(), 0);
+	p->items.swap(lst);
+	return p;
 }
 
-void _div__int()
+list_view_ptr flatten_view(const list_view_ptr& p)
 {
-	cat_assert(stk.count() >= 2);
-	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m / n);
+	list lst;
+	materialize(p.get(), lst);
+	return make_leaf(lst);
 }
 
-void _mod__int()
+list_view_ptr make_concat(const list_view_ptr& x, const list_view_ptr& y);
+
+list_view_ptr make_reverse(const list_view_ptr& x)
 {
-	cat_assert(stk.count() >= 2);
-	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m % n);
+	if (x->cnt < 2)
+		return x;
+	if (x->kind == list_view_node::reverse_kind)
+		return x->left;
+	new_view_ptr p = new_view_node(list_view_node::reverse_kind, x->cnt, x->depth + 1);
+	p->left = x;
+	list_view_ptr ret(p);
+	if (p->depth > max_view_depth)
+		return flatten_view(ret);
+	return ret;
 }
 
-void _lt__int()
+// Slices are pushed down towards the leaves so they never add depth
+list_view_ptr make_slice(const list_view_ptr& x, size_t first, size_t n)
 {
-	cat_assert(stk.count() >= 2);
-	int n = stk.pull().to<int>();
-	int m = stk.pull().to<int>();
-	stk.push(m < n);
+	if (first == 0 && n == x->cnt)
+		return x;
+	switch (x->kind)
+	{
+	case list_view_node::slice_kind:
+		return make_slice(x->left, x->first + first, n);
+	case list_view_node::reverse_kind:
+		return make_reverse(make_slice(x->left, x->cnt - first - n, n));
+	case list_view_node::concat_kind:
+		{
+			size_t mid = x->left->cnt;
+			if (first + n <= mid)
+				return make_slice(x->left, first, n);
+			if (first >= mid)
+				return make_slice(x->right, first - mid, n);
+			return make_concat(make_slice(x->left, first, mid - first), make_slice(x->right, 0, first + n - mid));
+		}
+	default:
+		{
+			new_view_ptr p = new_view_node(list_view_node::slice_kind, n, x->depth + 1);
+			p->left = x;
+			p->first = first;
+			return p;
+		}
+	}
 }
 
-void _neg__int()
+// The items of x come first, followed by the items of y
+list_view_ptr make_concat(const list_view_ptr& x, const list_view_ptr& y)
 {
-	cat_assert(stk.count() >= 1);
-	int n = stk.pull().to<int>();
-	stk.push(-n);
+	if (x->cnt == 0)
+		return y;
+	if (y->cnt == 0)
+		return x;
+	int depth = x->depth > y->depth ? x->depth : y->depth;
+	new_view_ptr p = new_view_node(list_view_node::concat_kind, x->cnt + y->cnt, depth + 1);
+	p->left = x;
+	p->right = y;
+	list_view_ptr ret(p);
+	if (p->depth > max_view_depth)
+		return flatten_view(ret);
+	return ret;
 }
 
-void _halt()
+// Returns a view of a list or view, moving the list into the view
+bool is_list(const object& o)
 {
-	stk.pop();
-	perror("test failed");
-	//exit(1);
+	if (o.is<interned>())
+		return is_list(o.to<interned>().node->value);
+	return o.is<list>() || o.is<list_view>() || o.is<list_deque>();
 }
 
-void _nil()
+bool is_function(const object& o)
 {
-	stk.push(list());
+	if (o.is<interned>())
+		return is_function(o.to<interned>().node->value);
+	return o.is<prim_function>() || o.is<quoted_value>() || o.is<composed_function>() 
+		|| o.is<closure>() || o.is<continuation>();
 }
 
-void _cons()
+unsigned char trace_tag_of(const object& o)
 {
-	cat_assert(stk.count() >= 2);
-	object o;
-	stk.top().move_to(o);
-	stk.pop_nodestroy();
-	list& lst = stk.top().to<list>();
-	lst.push_nocreate();
-	o.move_to(lst.top());
+	if (o.is<int>()) return tag_int;
+	if (o.is<bool>()) return tag_bool;
+	if (o.is<double>()) return tag_double;
+	if (o.is<cstring>()) return tag_string;
+	if (is_list(o)) return tag_list;
+	if (is_function(o)) return tag_function;
+	if (o.is<vector>()) return tag_vector;
+	if (o.is<hash_list>()) return tag_hash_list;
+	return tag_other;
 }
 
-void _uncons()
+// the tag of the last type seen, since the top of the stack usually has 
+// the same type from one call to the next
+thread_local const void* trace_last_type = NULL;
+thread_local unsigned char trace_last_tag = tag_empty;
+
+void trace_call(fxn_ptr f, unsigned char event)
 {
-	cat_assert(stk.count() >= 1);
-	list& lst = stk.top().to<list>();
-	if (lst.is_empty())
+	unsigned char tag = tag_empty;
+	if (!stk.is_empty())
 	{
-		_nil();
-		return;
+		const object& o = stk.top();
+		if (o.table == trace_last_type)
+		{
+			tag = trace_last_tag;
+		}
+		else 
+		{
+			tag = trace_tag_of(o);
+			// an interned value's tag depends on what it holds
+			if (!o.is<interned>())
+			{
+				trace_last_type = o.table;
+				trace_last_tag = tag;
+			}
+		}
 	}
-	stk.push_nocreate();
-	lst.top().move_to(stk.top());		
-	lst.pop_nodestroy();
+	trace_write_record(trace_def_id(f), event, stk.count(), tag);
 }
 
-void _eq()
+list& as_list(object& o);
+
+list_view_ptr as_view(object& o)
 {
-	cat_assert(stk.count() >= 2);
-	object o;
-	stk.top().move_to(o);
-	stk.pop_nodestroy();
-	if (stk.top() == o)
-		stk.top() = true;
-	else
-		stk.top() = false;
+	if (o.is<list_view>())
+		return o.to<list_view>().node;
+	return make_leaf(as_list(o));
 }
 
-void _dup()
+// moves the top item of one list onto another
+template<typename From_T, typename To_T>
+void move_top(From_T& from, To_T& to)
 {
-	cat_assert(stk.count() >= 1);
-	stk.push(stk.top());
+	to.push_nocreate();
+	from.top().move_to(to.top());
+	from.pop_nodestroy();
 }
 
-void _pop()
+// Materializes a view or a deque in place, so it can be modified as a list
+list& as_list(object& o)
 {
-	cat_assert(stk.count() >= 1);
-	stk.pop();
+	if (o.is<list_view>())
+	{
+		list lst;
+		materialize(o.to<list_view>().node.get(), lst);
+		o = list();
+		o.to<list>().swap(lst);
+	}
+	else if (o.is<list_deque>())
+	{
+		list_deque& d = o.to<list_deque>();
+		list lst;
+		// the top of the back stack is the last item of the list
+		list_stack& back = d.get_back_stack();
+		while (!back.is_empty())
+			move_top(back, lst);
+		list_stack& front = d.get_front_stack();
+		if (lst.is_empty())
+		{
+			lst.swap(front);
+		}
+		else
+		{
+			list tmp;
+			while (!front.is_empty())
+				move_top(front, tmp);
+			while (!tmp.is_empty())
+				move_top(tmp, lst);
+		}
+		o = list();
+		o.to<list>().swap(lst);
+	}
+	else if (o.is<interned>())
+	{
+		// the interned copy is shared, so it is copied
+		object tmp(o.to<interned>().node->value);
+		o.release();
+		tmp.move_to(o);
+	}
+	return o.to<list>();
 }
 
-void _true()
+// Turns a list into a deque in place, a list becomes the front of the 
+// deque so this is O(1) 
+list_deque& as_deque(object& o)
 {
-	stk.push(true);
+	if (!o.is<list_deque>())
+	{
+		list lst;
+		lst.swap(as_list(o));
+		o = list_deque();
+		lst.swap(o.to<list_deque>().get_front_stack());
+	}
+	return o.to<list_deque>();
 }
 
-void _false()
+// Materializes all views in a value, including those nested in lists
+void materialize_all(object& o)
 {
-	stk.push(false);
+	if (is_list(o))
+	{
+		list& lst = as_list(o);
+		for (size_t i=0; i < lst.count(); ++i)
+			materialize_all(lst[i]);
+	}
 }
 
-void _swap()
+size_t list_count(const object& o)
 {
-	cat_assert(stk.count() >= 2);
-	object& first = stk.top();
-	object& second = stk[1];
-	object tmp;
-	first.move_to(tmp);
-	second.move_to(first);
-	tmp.move_to(second);
+	if (o.is<interned>())
+		return list_count(o.to<interned>().node->value);
+	if (o.is<list_view>())
+		return o.to<list_view>().node->cnt;
+	if (o.is<list_deque>())
+		return o.to<list_deque>().count();
+	return o.to<list>().count();
 }
 
-void _quote()
+// n must be less than list_count(o)
+const object& list_at(const object& o, size_t n)
 {
-	cat_assert(stk.count() >= 1);
-	object o;
-	stk.top().move_to(o);
-	stk.pop_nodestroy();
-	stk.push(quoted_value(o));
+	cat_assert(n < list_count(o));
+	if (o.is<interned>())
+		return list_at(o.to<interned>().node->value, n);
+	if (o.is<list_view>())
+		return view_at(o.to<list_view>().node.get(), n);
+	if (o.is<list_deque>())
+		return o.to<list_deque>()[n];
+	return o.to<list>()[n];
 }
 
-void _if()
+// Compares ranges of the items of two lists. Items with the same bytes are 
+// the same value, so the whole range is compared with memcmp first. NaN is
+// the exception, it isn't equal to itself.
+bool items_equal(const object* x, const object* y, size_t n)
 {
-	cat_assert(stk.count() >= 3);
-	object onfalse;
-	stk.top().move_to(onfalse);
-	stk.pop_nodestroy();
-	object ontrue;
-	stk.top().move_to(ontrue);
-	stk.pop_nodestroy();
-	bool bCond = stk.top().to<bool>();
-	stk.pop_nodestroy();
-	if (bCond)
+	if (memcmp(x, y, n * sizeof(object)) == 0)
 	{
-		onfalse.release();
-		_eval(ontrue);
+		for (size_t i=0; i < n; ++i)
+			if (x[i].is<double>() && x[i].to<double>() != x[i].to<double>())
+				return false;
+		return true;
 	}
-	else 
+	for (size_t i=0; i < n; ++i)
+		if (!values_equal(x[i], y[i]))
+			return false;
+	return true;
+}
+
+// Compares values structurally, so a view equals a list with the same items.
+// The values of quotations, compositions, closures and hash lists are 
+// compared with it as well.
+// Interned values are only compared structurally with values which aren't.
+bool values_equal(const object& x, const object& y)
+{
+	if (x.is<interned>())
 	{
-		ontrue.release();
-		_eval(onfalse);
+		if (y.is<interned>())
+			return x.to<interned>().node == y.to<interned>().node;
+		return values_equal(x.to<interned>().node->value, y);
+	}
+	if (y.is<interned>())
+		return values_equal(x, y.to<interned>().node->value);
+	if (x.is<list>() && y.is<list>())
+	{
+		const list& a = x.to<list>();
+		const list& b = y.to<list>();
+		if (a.count() != b.count())
+			return false;
+		if (a.has_hash() && b.has_hash() && a.hash() != b.hash())
+			return false;
+		return a.compare_ranges(b, items_equal);
 	}
+	if (!is_list(x) || !is_list(y))
+		return x == y;
+	size_t n = list_count(x);
+	if (n != list_count(y))
+		return false;
+	for (size_t i=0; i < n; ++i)
+		if (!values_equal(list_at(x, i), list_at(y, i)))
+			return false;
+	return true;
 }
 
-void _compose()
+bool list_view::operator==(const list_view& x) const
 {
-	cat_assert(stk.count() >= 2);
-	object o;
-	stk.top().move_to(o);
-	stk.pop_nodestroy();
-	if (stk.top().is<composed_function>())
+	if (node == x.node)
+		return true;
+	return values_equal(object(*this), object(x));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// stack display functions
+
+void print_object(object& o);
+
+struct print_proc
+{
+	void operator()(const object& o)
 	{
-		composed_function& cf = stk.top().to<composed_function>();
-		cf.compose_with(o);
+		object tmp = o;
+		print_object(tmp);
+	}
+};
+
+// printing only reads the list, so its hash is kept
+void print_list(const list& l)
+{
+	print_proc proc;
+	printf("(");
+	l.foreach(proc);
+	printf(") ");
+}
+
+void print_view(const list_view_node* p)
+{
+	// printed in the same order as a list, with the head last
+	print_proc proc;
+	printf("(");
+	view_foreach(p, 0, p->cnt, true, proc);
+	printf(") ");
+}
+
+void print_object(object& o)
+{
+	if (o.is<int>())
+	{			
+		printf("%d ", o.to<int>());
+	}
+	else if (o.is<bool>())
+	{			
+		if (o.to<bool>())
+			printf("true ");
+		else 
+			printf("false ");
+	}
+	else if (o.is<double>())
+	{
+		printf("%g ", o.to<double>());
+	}
+	else if (o.is<cstring>())
+	{
+		printf("\"%s\" ", o.to<cstring>().to_ptr());
+	}
+	else if (o.is<list>())
+	{
+		print_list(o.to<list>());
+	}
+	else if (o.is<vector>())
+	{
+		vector& v = o.to<vector>();
+		printf("#(");
+		for (size_t i=0; i < v.count(); ++i)
+		{
+			object tmp = v[i];
+			print_object(tmp);
+		}
+		printf(") ");
+	}
+	else if (o.is<list_view>())
+	{
+		print_view(o.to<list_view>().node.get());
+	}
+	else if (o.is<list_deque>())
+	{
+		// printed in the same order as a list, with the head last
+		list_deque& d = o.to<list_deque>();
+		printf("(");
+		for (size_t i=d.count(); i > 0; --i)
+			print_object(d[i - 1]);
+		printf(") ");
+	}
+	else if (o.is<hash_list>())
+	{
+		printf("hash_list ");
+	}
+	else if (o.is<quoted_value>())
+	{
+		printf("[");
+		print_object(o.to<quoted_value>().value);
+		printf("] ");
+	}
+	else if (o.is<composed_function>())
+	{
+		composed_function& cf = o.to<composed_function>();
+		object* v = cf.values;
+		printf("{");
+		for (size_t i=0; i < cf.nsteps; ++i)
+		{
+			if (cf.steps[i] != NULL)
+			{
+				printf("fxn ");
+			}
+			else
+			{
+				printf("[");
+				print_object(*v++);
+				printf("] ");
+			}
+		}
+		printf("} ");
+	}
+	else if (o.is<prim_function>())
+	{
+		printf("fxn ");
+	}
+	else if (o.is<closure>())
+	{
+		closure& c = o.to<closure>();
+		printf("{");
+		for (size_t i=0; i < c.count; ++i)
+			print_object(c.values[i]);
+		printf("fxn } ");
+	}
+	else if (o.is<interned>())
+	{
+		object tmp(o.to<interned>().node->value);
+		print_object(tmp);
+	}
+	else if (o.is<continuation>())
+	{
+		printf("continuation ");
+	}
+	else if (o.is_empty())
+	{
+		printf("invalid object!");
+		cat_assert(false);
 	}
 	else
 	{
-		object o2;
-		stk.top().move_to(o2);
-		stk.pop_nodestroy();
-		stk.push(composed_function(o2, o));
+		cat_assert(false);
 	}
 }
 
-void _test()
+void print_stack()
+{		
+	// For debugging:
+	stk.foreach(print_object);
+	puts("");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Implementation functions
+
+#ifdef CAT_STATS
+void count_eval(const object& o)
 {
-	static int nTest = 0;
-	printf("test %d\n", nTest++);
-	scoped_timer timer;
-	
-	cat_assert(stk.count() == 1);
-	_eval(stk.pull());
-	if (stk.count() != 1)
+	cat_stats& s = cat_stats::local();
+	if (o.is<prim_function>()) ++s.evals[eval_prim];
+	else if (o.is<quoted_value>()) ++s.evals[eval_quotation];
+	else if (o.is<composed_function>()) ++s.evals[eval_composition];
+	else if (o.is<closure>()) ++s.evals[eval_closure];
+	else if (o.is<interned>()) ++s.evals[eval_interned];
+	else if (o.is<continuation>()) ++s.evals[eval_continuation];
+	if (stk.count() > s.max_depth)
+		s.max_depth = stk.count();
+}
+#endif
+
+// note: a function object can only ever be evaluated once.	
+// this is because a quoted_value will literally move its value into 
+// the stack invalidating itself
+void _eval(object& o)
+{
+#ifdef CAT_PROFILE
+	profile_frame pf(profile_quotation);
+#endif
+#ifdef CAT_STATS
+	count_eval(o);
+#endif
+	if (o.is<quoted_value>())
 	{
-		perror("test failed: expected a single value after running test");
+		o.to<quoted_value>().eval();
 	}
-	else if (!stk.top().is<bool>())
+	else if (o.is<composed_function>())
+	{
+		o.to<composed_function>().eval();
+	}
+	else if (o.is<prim_function>())
 	{
-		perror("test failed: expected a boolean value after running test");
+		call(o.to<prim_function>().fxn);
 	}
-	if (!stk.top().to<bool>())
+	else if (o.is<closure>())
 	{
-		perror("test failed: result was false");
+		o.to<closure>().eval();
 	}
-	stk.clear();
-	return;
-}
\ No newline at end of file
+	else if (o.is<interned>())
+	{
+		// the interned copy is shared, so a copy of it is evaluated
+		object f(o.to<interned>().node->value);
+		_eval(f);
+	}
+	else if (o.is<continuation>())
+	{
+		o.to<continuation>().eval();
+	}
+	else
+	{
+		// Not a function. Note that you could simply do nothing thus 
+		// echoing the value on the stack. 
+		// This would give you different langauge semantics.
+		cat_assert(false);
+	}
+	// the values of a function are moved out when it is evaluated, so 
+	// destroying it is cheap
+	o.release();
+}
+
+// note: this is not a reference, so the object doesn't get invalidated
+void _eval_copy(object o)
+{
+	_eval(o);
+}
+
+// evaluates the function on top of the stack
+void eval_top()
+{
+	object f;
+	stk.top().move_to(f);
+	stk.pop_nodestroy();
+	_eval(f);
+}
+
+void push_function(fxn_ptr fp)
+{
+	stk.push(prim_function(fp));
+#ifdef VERBOSE
+	print_stack();
+#endif
+}
+
+template<typename T>
+void push_literal(const T& x)
+{
+	stk.push(x);
+#ifdef VERBOSE
+	print_stack();
+#endif
+}
+
+// Pushes a function with a literal bound to it. The translator outputs this 
+// for "x [f] curry", "[f] x rcurry" and "[x] [f] compose".
+template<typename T>
+void push_closure(fxn_ptr fp, const T& x)
+{
+	object o(x);
+	stk.push(closure(fp));
+	stk.top().to<closure>().bind(o);
+	if (cat_hash_consing)
+		intern(stk.top());
+#ifdef VERBOSE
+	print_stack();
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// primitive functions 
+
+// Could be bootstrapped, but it would be very slow and complicated. It would require
+// using the Y or M combinator, and would be of only mild theoretical interest
+void _while()
+{
+	cat_require(2);
+	object cond;
+	object body;
+	stk.top().move_to(cond);
+	stk.pop_nodestroy();
+	stk.top().move_to(body);
+	stk.pop_nodestroy();
+	
+	// force a copy of the function: otherwise it would get invalidated
+	_eval_copy(cond);
+	while (stk.pull().to<bool>())
+	{
+		_eval_copy(body);
+		_eval_copy(cond);
+	}
+}
+
+// Could also be bootstrapped, but would be ridiculously slow
+void _empty()
+{
+	cat_require(1);
+	stk.push(list_count(stk.top()) == 0);
+}
+
+void _add__int()
+{
+	cat_require(2);
+	int n = stk.pull().to<int>();
+	int m = stk.pull().to<int>();
+	stk.push(m + n);
+}
+
+void _mul__int()
+{
+	cat_require(2);
+	int n = stk.pull().to<int>();
+	int m = stk.pull().to<int>();
+	stk.push(m * n);
+}
+
+void _div__int()
+{
+	cat_require(2);
+	int n = stk.pull().to<int>();
+	int m = stk.pull().to<int>();
+	stk.push(m / n);
+}
+
+void _mod__int()
+{
+	cat_require(2);
+	int n = stk.pull().to<int>();
+	int m = stk.pull().to<int>();
+	stk.push(m % n);
+}
+
+void _lt__int()
+{
+	cat_require(2);
+	int n = stk.pull().to<int>();
+	int m = stk.pull().to<int>();
+	stk.push(m < n);
+}
+
+void _neg__int()
+{
+	cat_require(1);
+	int n = stk.pull().to<int>();
+	stk.push(-n);
+}
+
+void _halt()
+{
+	cat_require(1);
+	stk.pop();
+	cat_fail("test failed");
+	//exit(1);
+}
+
+void _nil()
+{
+	stk.push(list());
+}
+
+void _cons()
+{
+	cat_require(2);
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	if (stk.top().is<list_deque>())
+	{
+		list_stack& front = stk.top().to<list_deque>().get_front_stack();
+		front.push_nocreate();
+		o.move_to(front.top());
+	}
+	else
+	{
+		list& lst = as_list(stk.top());
+		lst.push_nocreate();
+		o.move_to(lst.top());
+	}
+}
+
+void _uncons()
+{
+	cat_require(1);
+	if (stk.top().is<list_view>())
+	{
+		// the rest of a view is a slice, so there is no need to materialize 
+		list_view_ptr p = stk.top().to<list_view>().node;
+		if (p->cnt == 0)
+		{
+			_nil();
+			return;
+		}
+		object head = view_at(p.get(), 0);
+		stk.top() = list_view(make_slice(p, 1, p->cnt - 1));
+		stk.push(head);
+		return;
+	}
+	if (stk.top().is<list_deque>())
+	{
+		list_deque& d = stk.top().to<list_deque>();
+		if (d.is_empty())
+		{
+			_nil();
+			return;
+		}
+		// makes sure the front stack isn't empty
+		d.front();
+		move_top(d.get_front_stack(), stk);
+		return;
+	}
+	list& lst = as_list(stk.top());
+	if (lst.is_empty())
+	{
+		_nil();
+		return;
+	}
+	stk.push_nocreate();
+	lst.top().move_to(stk.top());		
+	lst.pop_nodestroy();
+}
+
+// ( list any -> list ), adds an item to the end of a list. The list 
+// becomes a deque, so both ends can be used in constant time.
+void _snoc()
+{
+	cat_require(2);
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	list_stack& back = as_deque(stk.top()).get_back_stack();
+	back.push_nocreate();
+	o.move_to(back.top());
+}
+
+// ( list -> list any ), removes the last item of a list
+void _unsnoc()
+{
+	cat_require(1);
+	list_deque& d = as_deque(stk.top());
+	if (d.is_empty())
+	{
+		_nil();
+		return;
+	}
+	// makes sure the back stack isn't empty
+	d.back();
+	move_top(d.get_back_stack(), stk);
+}
+
+void _eq()
+{
+	cat_require(2);
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	// Lists which have kept their hashes are told apart without looking at 
+	// their items (see values_equal).
+	object& x = stk.top();
+	if (values_equal(x, o))
+		stk.top() = true;
+	else
+		stk.top() = false;
+}
+
+void _dup()
+{
+	cat_require(1);
+	stk.push(stk.top());
+}
+
+void _pop()
+{
+	cat_require(1);
+	stk.pop();
+}
+
+void _true()
+{
+	stk.push(true);
+}
+
+void _false()
+{
+	stk.push(false);
+}
+
+void _swap()
+{
+	cat_require(2);
+	object& first = stk.top();
+	object& second = stk[1];
+	object tmp;
+	first.move_to(tmp);
+	second.move_to(first);
+	tmp.move_to(second);
+}
+
+void _quote()
+{
+	cat_require(1);
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	stk.push(quoted_value(o));
+#ifdef CAT_STATS
+	++cat_stats::local().quotations;
+#endif
+	if (cat_hash_consing)
+		intern(stk.top());
+}
+
+void _if()
+{
+	cat_require(3);
+	object onfalse;
+	stk.top().move_to(onfalse);
+	stk.pop_nodestroy();
+	object ontrue;
+	stk.top().move_to(ontrue);
+	stk.pop_nodestroy();
+	bool bCond = stk.top().to<bool>();
+	stk.pop_nodestroy();
+	if (bCond)
+	{
+		onfalse.release();
+		_eval(ontrue);
+	}
+	else 
+	{
+		ontrue.release();
+		_eval(onfalse);
+	}
+}
+
+// ( any -> )
+void _throw()
+{
+	cat_require(1);
+	cat_exception e(stk.top());
+	stk.pop();
+	throw e;
+}
+
+// ( ( -> 'A) (any -> 'A) -> 'A ), evaluates the first function, and if it 
+// throws, pops the stack back to its depth before the call and evaluates 
+// the second function with the thrown value. Nothing is done on entry 
+// besides recording the depth.
+void _try__catch()
+{
+	cat_require(2);
+	object c;
+	stk.top().move_to(c);
+	stk.pop_nodestroy();
+	object t;
+	stk.top().move_to(t);
+	stk.pop_nodestroy();
+	size_t n = stk.count();
+	try
+	{
+		_eval(t);
+	}
+	catch (cat_exception& e)
+	{
+		if (stk.count() > n)
+			stk.pop_n(stk.count() - n);
+		stk.push_nocreate();
+		e.data.move_to(stk.top());
+		_eval(c);
+		return;
+	}
+	c.release();
+}
+
+// ( 'A ('A ('B -> 'C) -> 'B) ~> 'B ), calls a function with an escape 
+// continuation (see continuation above). 
+void _callcc()
+{
+	cat_require(1);
+	object f;
+	stk.top().move_to(f);
+	stk.pop_nodestroy();
+	size_t id = ++next_continuation_id;
+	live_continuations.push_back(id);
+	stk.push(continuation(id));
+	try
+	{
+		_eval(f);
+	}
+	catch (continuation_jump& j)
+	{
+		live_continuations.pop_back();
+		if (j.id != id)
+			throw;
+		return;
+	}
+	catch (...)
+	{
+		live_continuations.pop_back();
+		throw;
+	}
+	live_continuations.pop_back();
+}
+
+void _compose()
+{
+	cat_require(2);
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	if (stk.top().is<composed_function>())
+	{
+		composed_function& cf = stk.top().to<composed_function>();
+		cf.compose_with(o);
+	}
+	else
+	{
+		object o2;
+		stk.top().move_to(o2);
+		stk.pop_nodestroy();
+		if (o2.is<quoted_value>() && as_closure(o))
+		{
+			// [x] [f] compose binds x to f
+			o.to<closure>().bind(o2.to<quoted_value>().value);
+			o2.release();
+			stk.push_nocreate();
+			o.move_to(stk.top());
+		}
+		else
+		{
+			stk.push(composed_function());
+			composed_function& cf = stk.top().to<composed_function>();
+			cf.compose_with(o2);
+			cf.compose_with(o);
+#ifdef CAT_STATS
+			++cat_stats::local().compositions;
+#endif
+		}
+	}
+	if (cat_hash_consing)
+		intern(stk.top());
+}
+
+// ( 'a ('A -> 'B) -> ('A -> 'a 'B) ), binds a value to a function. The 
+// library definition quotes the value and composes it with the function, 
+// which is still done for functions which can't be made into closures.
+void _curry()
+{
+	cat_require(2);
+	object f;
+	stk.top().move_to(f);
+	stk.pop_nodestroy();
+	if (!as_closure(f))
+	{
+		_quote();
+		stk.push_nocreate();
+		f.move_to(stk.top());
+		_compose();
+		return;
+	}
+	f.to<closure>().bind(stk.top());
+	f.move_to(stk.top());
+	if (cat_hash_consing)
+		intern(stk.top());
+}
+
+// ( ('A -> 'B) 'a -> ('A -> 'a 'B) )
+void _rcurry()
+{
+	_swap();
+	_curry();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// regions
+//
+// An evaluation can be run in the thread's region (see ootl_arena.hpp). The 
+// values it makes are allocated from the region, and when it is done they 
+// are released all at once by resetting the region, instead of one by one.
+// Values it leaves on the stack are copied out of the region first.
+
+// Copies a value and everything it refers to into "out", allocating from 
+// the region if it is enabled. Vectors, hash lists and views share memory 
+// between copies, so they are rebuilt item by item. Views and deques are 
+// copied as lists.
+void deep_copy(const object& o, object& out);
+
+struct deep_copy_entry_proc
+{
+	deep_copy_entry_proc(hash_list& x)
+		: h(x)
+	{ }
+	void operator()(const hash_list::entry& e)
+	{
+		object key;
+		object value;
+		deep_copy(e.key, key);
+		deep_copy(e.value, value);
+		h.set(key, value);
+	}
+	hash_list& h;
+};
+
+void deep_copy(const object& o, object& out)
+{
+	if (is_list(o))
+	{
+		out = list();
+		list& lst = out.to<list>();
+		// pushing from the last item leaves the first item on top
+		for (size_t i=list_count(o); i > 0; --i)
+		{
+			lst.push();
+			deep_copy(list_at(o, i - 1), lst.top());
+		}
+	}
+	else if (o.is<vector>())
+	{
+		out = vector();
+		const vector& v = o.to<vector>();
+		vector& ret = out.to<vector>();
+		for (size_t i=0; i < v.count(); ++i)
+		{
+			object tmp;
+			deep_copy(v[i], tmp);
+			ret.push(tmp);
+		}
+	}
+	else if (o.is<hash_list>())
+	{
+		out = hash_list();
+		deep_copy_entry_proc proc(out.to<hash_list>());
+		o.to<hash_list>().foreach(proc);
+	}
+	else if (o.is<quoted_value>())
+	{
+		object tmp;
+		out = quoted_value(tmp);
+		deep_copy(o.to<quoted_value>().value, out.to<quoted_value>().value);
+	}
+	else if (o.is<composed_function>())
+	{
+		const composed_function& cf = o.to<composed_function>();
+		out = composed_function();
+		composed_function& ret = out.to<composed_function>();
+		const object* v = cf.values;
+		for (size_t i=0; i < cf.nsteps; ++i)
+		{
+			if (cf.steps[i] != NULL)
+			{
+				ret.push_step(cf.steps[i]);
+			}
+			else
+			{
+				object tmp;
+				deep_copy(*v++, tmp);
+				ret.push_value(tmp);
+			}
+		}
+	}
+	else if (o.is<closure>())
+	{
+		const closure& c = o.to<closure>();
+		out = closure(c.fxn);
+		closure& ret = out.to<closure>();
+		for (size_t i=0; i < c.count; ++i)
+			deep_copy(c.values[i], ret.values[i]);
+		ret.count = c.count;
+	}
+	else
+	{
+		out = o;
+	}
+}
+
+// Empties the stack. The values are released with the region if it is in 
+// use, otherwise they are destroyed. They are also destroyed if interned
+// values were made in the region, to release their references.
+void discard_stack()
+{
+	region& r = region::local();
+	if (r.is_enabled() && !r.overflowed() && !interned_in_region)
+		stk.clear_nodestroy();
+	else
+		stk.clear();
+	if (r.is_enabled())
+		interned_in_region = false;
+}
+
+// Calls proc with the thread's region enabled, then copies the values left 
+// on the stack out of the region and resets it. The stack must be empty 
+// beforehand, so that nothing made outside of the region can come to refer 
+// to it. Otherwise, or if the region is already in use, proc is just called.
+// So it is if the region is unavailable, which is reported once per thread.
+template<typename Procedure>
+void run_in_region(Procedure& proc)
+{
+	region& r = region::local();
+	if (r.is_enabled() || !stk.is_empty())
+	{
+		proc();
+		return;
+	}
+	if (!r.enable())
+	{
+		static thread_local bool reported = false;
+		if (!reported)
+			fprintf(stderr, "region unavailable, allocating from the heap: %s\n", r.why_unavailable());
+		reported = true;
+		proc();
+		return;
+	}
+	bool jumped = false;
+	size_t jump_id = 0;
+	try
+	{
+		proc();
+	}
+	catch (continuation_jump& j)
+	{
+		// the stack is kept, so the results are copied out below
+		jumped = true;
+		jump_id = j.id;
+	}
+	catch (cat_exception& e)
+	{
+		// the thrown value is copied out of the region, like the results
+		r.disable();
+		object tmp;
+		deep_copy(e.data, tmp);
+		r.enable();
+		e.data.release();
+		tmp.move_to(e.data);
+		discard_stack();
+		r.disable();
+		r.reset();
+		throw;
+	}
+	catch (...)
+	{
+		discard_stack();
+		r.disable();
+		r.reset();
+		throw;
+	}
+	r.disable();
+	data_stack results;
+	for (size_t i=stk.count(); i > 0; --i)
+	{
+		results.push();
+		deep_copy(stk[i - 1], results.top());
+	}
+	r.enable();
+	discard_stack();
+	r.disable();
+	r.reset();
+	stk.swap(results);
+	if (jumped)
+		throw continuation_jump(jump_id);
+}
+
+// Evaluates a copy of a function made in the region. The function itself 
+// isn't used, because values moved out of it could end up inside of values 
+// from the region, which aren't destroyed.
+struct region_eval_proc
+{
+	region_eval_proc(object& x)
+		: o(x)
+	{ }
+	void operator()()
+	{
+		if (!region::local().is_enabled())
+		{
+			_eval(o);
+			return;
+		}
+		object f;
+		deep_copy(o, f);
+		_eval(f);
+		if (!region::local().overflowed())
+			f.release_nodestroy();
+	}
+	object& o;
+};
+
+void _test()
+{
+	static int nTest = 0;
+	printf("test %d\n", nTest++);
+	scoped_timer timer;
+	
+	cat_assert(stk.count() == 1);
+	object f = stk.pull();
+	region_eval_proc proc(f);
+	try
+	{
+		run_in_region(proc);
+	}
+	catch (cat_exception&)
+	{
+		stk.clear();
+		cat_fail("test failed: uncaught exception");
+		return;
+	}
+	if (stk.count() != 1)
+	{
+		cat_fail("test failed: expected a single value after running test");
+	}
+	else if (!stk.top().is<bool>())
+	{
+		cat_fail("test failed: expected a boolean value after running test");
+	}
+	if (!stk.top().to<bool>())
+	{
+		cat_fail("test failed: result was false");
+	}
+	stk.clear();
+	return;
+}
+//////////////////////////////////////////////////////////////////////////////
+// vector primitives
+//
+// Vectors are persistent, an updated vector shares its unchanged nodes with
+// the original, so get, set, push, and slice are all O(log n). Index 0 
+// is the first item pushed.
+
+void _vec__nil()
+{
+	stk.push(vector());
+}
+
+// ( vector any -> vector )
+void _vec__push()
+{
+	cat_require(2);
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	stk.top().to<vector>().push(o);
+}
+
+// Throws an index unless it is in [0, n), since there is no item to leave 
+// in its place, like hash_get does with a missing key
+void vec_check_index(int i, size_t n)
+{
+	if (i < 0 || (size_t)i >= n)
+		throw cat_exception(object(i));
+}
+
+// ( vector -> vector any ), throws -1 if the vector is empty
+void _vec__pop()
+{
+	cat_require(1);
+	vector& v = stk.top().to<vector>();
+	vec_check_index((int)v.count() - 1, v.count());
+	object o = v.top();
+	v.pop();
+	stk.push(o);
+}
+
+// ( vector -> vector int )
+void _vec__count()
+{
+	cat_require(1);
+	stk.push(static_cast<int>(stk.top().to<vector>().count()));
+}
+
+// ( vector int -> vector any ), throws the index if it is out of range
+void _vec__nth()
+{
+	cat_require(2);
+	int n = stk.pull().to<int>();
+	vec_check_index(n, stk.top().to<vector>().count());
+	stk.push(stk.top().to<vector>()[n]);
+}
+
+// ( vector any int -> vector ), throws the index if it is out of range
+void _vec__set__at()
+{
+	cat_require(3);
+	int n = stk.pull().to<int>();
+	vec_check_index(n, stk[1].to<vector>().count());
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	stk.top().to<vector>().set_at(n, o);
+}
+
+// ( vector int int -> vector ) 
+// Leaves the items from the first index up to but not including the second.
+// Throws an index which is out of range, or the second if it is less than 
+// the first.
+void _vec__slice()
+{
+	cat_require(3);
+	int last = stk.pull().to<int>();
+	int first = stk.pull().to<int>();
+	vector& v = stk.top().to<vector>();
+	vec_check_index(first, v.count() + 1);
+	vec_check_index(last, v.count() + 1);
+	if (last < first)
+		throw cat_exception(object(last));
+	v = v.slice(first, last);
+}
+
+// ( vector vector -> vector )
+void _vec__cat()
+{
+	cat_require(2);
+	object o;
+	stk.top().move_to(o);
+	stk.pop_nodestroy();
+	stk.top().to<vector>().concat(o.to<vector>());
+}
+
+// ( list -> vector ), the head of the list becomes the first item
+void _list__to__vec()
+{
+	cat_require(1);
+	vector v;
+	for (size_t i=0; i < list_count(stk.top()); ++i)
+		v.push(list_at(stk.top(), i));
+	stk.top() = v;
+}
+
+// ( vector -> list )
+void _vec__to__list()
+{
+	cat_require(1);
+	vector& v = stk.top().to<vector>();
+	list lst;
+	for (size_t i=v.count(); i > 0; --i)
+		lst.push(v[i - 1]);
+	stk.top() = lst;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// hash list primitives
+//
+// Hash lists are persistent maps, setting a key in a duplicated hash list
+// copies only the nodes on the path to the key.
+// Keys are compared with ==, so views in keys are materialized first.
+
+u8 hash_object(const object& o)
+{
+	if (o.is<int>())
+	{
+		int n = o.to<int>();
+		return fnv_hash(reinterpret_cast<const char*>(&n), sizeof(n));
+	}
+	else if (o.is<bool>())
+	{
+		return o.to<bool>() ? 1 : 2;
+	}
+	else if (o.is<double>())
+	{
+		// -0.0 equals 0.0, so they must hash the same, and every NaN 
+		// hashes the same whatever its bits
+		double d = o.to<double>();
+		if (d == 0.0)
+			d = 0.0;
+		else if (d != d)
+			d = std::numeric_limits<double>::quiet_NaN();
+		return fnv_hash(reinterpret_cast<const char*>(&d), sizeof(d));
+	}
+	else if (o.is<cstring>())
+	{
+		const char* s = o.to<cstring>().to_ptr();
+		return fnv_hash(s, strlen(s));
+	}
+	else if (o.is<list>())
+	{
+		return o.to<list>().hash();
+	}
+	else if (is_list(o))
+	{
+		// views hash the same as lists with the same items
+		u8 h = fnv_hash("(", 1);
+		for (size_t i=0; i < list_count(o); ++i)
+			h = hash_item(h, list_at(o, i));
+		return h;
+	}
+	else if (o.is<interned>())
+	{
+		return o.to<interned>().node->hash;
+	}
+	else if (o.is<quoted_value>())
+	{
+		return hash_item(fnv_hash("[", 1), o.to<quoted_value>().value);
+	}
+	else if (o.is<composed_function>())
+	{
+		// kept by the composition, like the hash of a list
+		const composed_function& cf = o.to<composed_function>();
+		if (!cf.hashed)
+		{
+			u8 h = fnv_hash("{", 1);
+			const object* v = cf.values;
+			for (size_t i=0; i < cf.nsteps; ++i)
+			{
+				if (cf.steps[i] != NULL)
+					h = fnv_hash(reinterpret_cast<const char*>(&cf.steps[i]), sizeof(fxn_ptr), h);
+				else
+					h = hash_item(h, *v++);
+			}
+			cf.hash = h;
+			cf.hashed = true;
+		}
+		return cf.hash;
+	}
+	else if (o.is<prim_function>())
+	{
+		fxn_ptr f = o.to<prim_function>().fxn;
+		return fnv_hash(reinterpret_cast<const char*>(&f), sizeof(f));
+	}
+	else if (o.is<closure>())
+	{
+		const closure& c = o.to<closure>();
+		u8 h = fnv_hash(reinterpret_cast<const char*>(&c.fxn), sizeof(c.fxn), fnv_hash("{", 1));
+		for (size_t i=0; i < c.count; ++i)
+			h = hash_item(h, c.values[i]);
+		return h;
+	}
+	else
+	{
+		// other values all share a hash, and are told apart by comparison
+		const char* s = o.type_info().name();
+		return fnv_hash(s, strlen(s));
+	}
+}
+
+struct hash_list_to_list_proc
+{
+	hash_list_to_list_proc(list& x)
+		: lst(x)
+	{ }
+	void operator()(const hash_list::entry& e)
+	{
+		// a pair, with the key on top 
+		list pair;
+		pair.push(e.value);
+		pair.push(e.key);
+		lst.push(pair);
+	}
+	list& lst;
+};
+
+void _hash__list()
+{
+	stk.push(hash_list());
+}
+
+// ( hash_list key -> hash_list any ), throws the key if it isn't present, 
+// since there is no value to leave in its place
+void _hash__get()
+{
+	cat_require(2);
+	object key = stk.pull();
+	materialize_all(key);
+	const object* value = stk.top().to<hash_list>().find(key);
+	if (value == NULL)
+		throw cat_exception(key);
+	stk.push(*value);
+}
+
+// ( hash_list value key -> hash_list )
+void _hash__set()
+{
+	cat_require(3);
+	object key = stk.pull();
+	materialize_all(key);
+	object value = stk.pull();
+	stk.top().to<hash_list>().set(key, value);
+}
+
+// ( hash_list value key -> hash_list ) 
+// Like hash_set, but the key must not already be present.
+void _hash__add()
+{
+	cat_require(3);
+	object key = stk.pull();
+	materialize_all(key);
+	object value = stk.pull();
+	hash_list& h = stk.top().to<hash_list>();
+	if (h.contains(key))
+	{
+		cat_fail("key already in hash_list");
+		return;
+	}
+	h.set(key, value);
+}
+
+// ( hash_list key -> hash_list bool )
+void _hash__contains()
+{
+	cat_require(2);
+	object key = stk.pull();
+	materialize_all(key);
+	stk.push(stk.top().to<hash_list>().contains(key));
+}
+
+// ( hash_list key -> hash_list )
+void _hash__remove()
+{
+	cat_require(2);
+	object key = stk.pull();
+	materialize_all(key);
+	stk.top().to<hash_list>().remove(key);
+}
+
+// ( hash_list -> hash_list int )
+void _hash__count()
+{
+	cat_require(1);
+	stk.push(static_cast<int>(stk.top().to<hash_list>().count()));
+}
+
+// ( hash_list -> list )
+void _hash__to__list()
+{
+	cat_require(1);
+	list lst;
+	hash_list_to_list_proc proc(lst);
+	stk.top().to<hash_list>().foreach(proc);
+	stk.top() = lst;
+}
+
+void stats_set(hash_list& h, const char* k, size_t n)
+{
+	h.set(object(k), object(n > INT_MAX ? INT_MAX : (int)n));
+}
+
+// ( -> hash_list ), the statistics of all threads by name (see cat_stats.hpp), 
+// objects_created and evals are hash lists by type and kind. They are zero 
+// unless the program is built with CAT_STATS defined.
+void _stats()
+{
+	ootl::stats o;
+	ootl::stats::total(o);
+	cat_stats c;
+	cat_stats::total(c);
+	hash_list types;
+	for (size_t i=0; i < ootl::stats::type_count(); ++i)
+		stats_set(types, ootl::stats::type_name(i), o.objects_created[i]);
+	hash_list evals;
+	for (int i=0; i < eval_kinds; ++i)
+		stats_set(evals, eval_kind_names[i], c.evals[i]);
+	hash_list h;
+	h.set(object("objects_created"), object(types));
+	stats_set(h, "payload_bytes_allocated", o.payload_bytes_allocated);
+	stats_set(h, "payload_bytes_freed", o.payload_bytes_freed);
+	stats_set(h, "buffers_added", o.buffers_added);
+	stats_set(h, "buffers_removed", o.buffers_removed);
+	h.set(object("evals"), object(evals));
+	stats_set(h, "compositions", c.compositions);
+	stats_set(h, "quotations", c.quotations);
+	stats_set(h, "max_stack_depth", c.max_depth);
+	stk.push(h);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// hash consing
+//
+// The intern table holds weak references to the interned values, so a value 
+// is removed when the last reference to it is released. It is split into 
+// shards by hash, each with its own lock, so threads rarely wait on each 
+// other. The items of interned values are interned too, which makes 
+// comparing them in the table a pointer comparison per item.
+
+struct intern_table
+{
+	static const size_t num_shards = 16;
+
+	typedef std::weak_ptr<const interned_node> entry;
+	typedef std::unordered_multimap<u8, entry> entry_map;
+
+	struct shard
+	{
+		std::mutex mutex;
+		entry_map entries;
+	};
+
+	// never destroyed, so that values released at exit can still find it
+	static intern_table& instance()
+	{
+		static intern_table* table = new intern_table();
+		return *table;
+	}
+
+	// Returns the interned value equal to o, or interns o if there is none, 
+	// in which case o is moved into the table.
+	interned_ptr find_or_add(object& o, u8 h)
+	{
+		// The references taken to candidates are released after the lock, 
+		// because releasing the last one removes it from the table.
+		std::vector<interned_ptr> candidates;
+		shard& s = get_shard(h);
+		std::lock_guard<std::mutex> lock(s.mutex);
+		std::pair<entry_map::iterator, entry_map::iterator> range = s.entries.equal_range(h);
+		for (entry_map::iterator i = range.first; i != range.second; ++i)
+		{
+			candidates.push_back(i->second.lock());
+			const interned_ptr& p = candidates.back();
+			if (p.get() != NULL && values_equal(p->value, o))
+				return p;
+		}
+		interned_ptr p(new interned_node(o, h), deleter());
+		s.entries.insert(std::make_pair(h, entry(p)));
+		return p;
+	}
+
+private:
+
+	struct deleter
+	{
+		void operator()(const interned_node* p) const
+		{
+			instance().remove_expired(p->hash);
+			delete p;
+		}
+	};
+
+	shard& get_shard(u8 h)
+	{
+		return shards[(h ^ (h >> 32)) % num_shards];
+	}
+
+	void remove_expired(u8 h)
+	{
+		shard& s = get_shard(h);
+		std::lock_guard<std::mutex> lock(s.mutex);
+		std::pair<entry_map::iterator, entry_map::iterator> range = s.entries.equal_range(h);
+		for (entry_map::iterator i = range.first; i != range.second; )
+		{
+			if (i->second.expired())
+				i = s.entries.erase(i);
+			else
+				++i;
+		}
+	}
+
+	shard shards[num_shards];
+};
+
+// Interned values live outside of any region, so the thread's region is 
+// disabled while they are made.
+struct region_pause
+{
+	region_pause()
+		: enabled(region::local().is_enabled())
+	{
+		region::local().disable();
+	}
+	~region_pause()
+	{
+		if (enabled)
+			region::local().enable();
+	}
+	bool enabled;
+};
+
+bool intern_into(const object& o, object& out);
+
+// Copies a value into "out" in the form in which it is interned: views and 
+// deques become lists, and items which are lists or functions are interned. 
+// Returns false if the value holds something that can't be shared between 
+// threads: vectors and hash lists share nodes with counts which aren't 
+// atomic, and strings may belong to a host.
+bool make_internable(const object& o, object& out)
+{
+	if (is_list(o))
+	{
+		out = list();
+		list& lst = out.to<list>();
+		// pushing from the last item leaves the first item on top
+		for (size_t i=list_count(o); i > 0; --i)
+		{
+			lst.push();
+			if (!intern_into(list_at(o, i - 1), lst.top()))
+				return false;
+		}
+		return true;
+	}
+	if (o.is<quoted_value>())
+	{
+		object tmp;
+		out = quoted_value(tmp);
+		return intern_into(o.to<quoted_value>().value, out.to<quoted_value>().value);
+	}
+	if (o.is<composed_function>())
+	{
+		const composed_function& cf = o.to<composed_function>();
+		out = composed_function();
+		composed_function& ret = out.to<composed_function>();
+		const object* v = cf.values;
+		for (size_t i=0; i < cf.nsteps; ++i)
+		{
+			if (cf.steps[i] != NULL)
+			{
+				ret.push_step(cf.steps[i]);
+			}
+			else
+			{
+				object tmp;
+				if (!intern_into(*v++, tmp))
+					return false;
+				ret.push_value(tmp);
+			}
+		}
+		return true;
+	}
+	if (o.is<closure>())
+	{
+		const closure& c = o.to<closure>();
+		out = closure(c.fxn);
+		closure& ret = out.to<closure>();
+		for (; ret.count < c.count; ++ret.count)
+			if (!intern_into(c.values[ret.count], ret.values[ret.count]))
+				return false;
+		return true;
+	}
+	return false;
+}
+
+// Sets "out" to the interned copy of o, or to o itself if it has no parts
+bool intern_into(const object& o, object& out)
+{
+	if (o.is<int>() || o.is<bool>() || o.is<double>() || o.is<prim_function>() || o.is<interned>())
+	{
+		out = o;
+		return true;
+	}
+	object tmp;
+	if (!make_internable(o, tmp))
+		return false;
+	out = interned(intern_table::instance().find_or_add(tmp, hash_object(tmp)));
+	return true;
+}
+
+// Replaces a list or a function with its interned copy. Returns false if 
+// it can't be interned, in which case it is left as it is.
+bool intern(object& o)
+{
+	if (!is_list(o) && !is_function(o))
+		return false;
+	if (o.is<interned>())
+		return true;
+	interned_ptr p;
+	{
+		region_pause pause;
+		object tmp;
+		if (!make_internable(o, tmp))
+			return false;
+		p = intern_table::instance().find_or_add(tmp, hash_object(tmp));
+	}
+	o = interned(p);
+	return true;
+}
+
+// ( any -> any ), interns a list or function, so that it shares its memory 
+// with equal values and compares equal to them in constant time. Other 
+// values, and values which hold vectors, hash lists or strings, are left 
+// as they are.
+void _intern()
+{
+	cat_require(1);
+	intern(stk.top());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// native list functions
+//
+// These replace library definitions which rebuild lists an item at a time,
+// they return views instead so they run in constant or logarithmic time. 
+
+// Replaces the list or view on top of the stack with a view
+void push_view(const list_view_ptr& p)
+{
+	stk.top() = list_view(p);
+}
+
+// Pulls an item count from above a list or view, clamped to its length
+size_t pull_count()
+{
+	int n = stk.pull().to<int>();
+	size_t max = list_count(stk.top());
+	if (n < 0) 
+		return 0;
+	return (size_t)n > max ? max : (size_t)n;
+}
+
+// ( list -> list int )
+void _count()
+{
+	cat_require(1);
+	stk.push(static_cast<int>(list_count(stk.top())));
+}
+
+// ( list int -> list var ), an index out of range gives an empty list, 
+// as uncons does for an empty list
+void _nth()
+{
+	cat_require(2);
+	int n = stk.pull().to<int>();
+	if (n < 0 || (size_t)n >= list_count(stk.top()))
+	{
+		_nil();
+		return;
+	}
+	stk.push(list_at(stk.top(), n));
+}
+
+// ( list int -> list ), the first n items
+void _take()
+{
+	cat_require(2);
+	size_t n = pull_count();
+	push_view(make_slice(as_view(stk.top()), 0, n));
+}
+
+// ( list int -> list ), all but the first n items
+void _drop()
+{
+	cat_require(2);
+	size_t n = pull_count();
+	list_view_ptr p = as_view(stk.top());
+	push_view(make_slice(p, n, p->cnt - n));
+}
+
+// ( list int -> list list ), leaves the rest of the list, and the first 
+// n items reversed on top
+void _split__at()
+{
+	cat_require(2);
+	size_t n = pull_count();
+	list_view_ptr p = as_view(stk.top());
+	push_view(make_slice(p, n, p->cnt - n));
+	stk.push(list_view(make_reverse(make_slice(p, 0, n))));
+}
+
+// ( list list -> list ), the items of the top list come first
+void _cat()
+{
+	cat_require(2);
+	list_view_ptr p = as_view(stk.top());
+	stk.pop();
+	push_view(make_concat(p, as_view(stk.top())));
+}
+
+// ( list -> list )
+void _rev()
+{
+	cat_require(1);
+	push_view(make_reverse(as_view(stk.top())));
+}
+
+// Concatenates views as a balanced tree, so the depth only grows by log n
+list_view_ptr concat_range(list& lst, size_t first, size_t n)
+{
+	if (n == 1)
+		return as_view(lst[first]);
+	size_t half = n / 2;
+	return make_concat(concat_range(lst, first, half), concat_range(lst, first + half, n - half));
+}
+
+// ( list -> list ), concatenates a list of lists
+void _flatten()
+{
+	cat_require(1);
+	list& lst = as_list(stk.top());
+	if (lst.is_empty())
+		return;
+	push_view(concat_range(lst, 0, lst.count()));
+}
+
+// ( list -> list ), removes the items which equal an item nearer to the 
+// head. Items are grouped by hash, and lists keep their hashes, so lists 
+// of lists are only compared item by item when their hashes are the same.
+void _distinct()
+{
+	cat_require(1);
+	const list& lst = as_list(stk.top());
+	typedef std::unordered_multimap<u8, size_t> index_map;
+	index_map seen;
+	std::vector<size_t> kept;
+	for (size_t i=0; i < lst.count(); ++i)
+	{
+		u8 h = hash_object(lst[i]);
+		bool found = false;
+		std::pair<index_map::iterator, index_map::iterator> range = seen.equal_range(h);
+		for (index_map::iterator j = range.first; j != range.second && !found; ++j)
+			found = values_equal(lst[j->second], lst[i]);
+		if (!found)
+		{
+			seen.insert(std::make_pair(h, i));
+			kept.push_back(i);
+		}
+	}
+	if (kept.size() == lst.count())
+		return;
+	list ret;
+	for (size_t k=kept.size(); k > 0; --k)
+		ret.push(lst[kept[k - 1]]);
+	stk.top().to<list>().swap(ret);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// definition table 
+
+struct cat_def
+{
+	const char* name;
+	fxn_ptr fxn;
+	// hash of the bodies of a library definition and its callees, zero for primitives
+	unsigned long long hash;
+};
+
+// generated by the translator, at the end of the library output
+extern cat_def cat_lib_defs[];
+
+cat_def cat_prim_defs[] = {
+    { "while", _while, 0 },
+    { "empty", _empty, 0 },
+    { "add_int", _add__int, 0 },
+    { "mul_int", _mul__int, 0 },
+    { "div_int", _div__int, 0 },
+    { "mod_int", _mod__int, 0 },
+    { "lt_int", _lt__int, 0 },
+    { "neg_int", _neg__int, 0 },
+    { "halt", _halt, 0 },
+    { "nil", _nil, 0 },
+    { "cons", _cons, 0 },
+    { "uncons", _uncons, 0 },
+    { "snoc", _snoc, 0 },
+    { "unsnoc", _unsnoc, 0 },
+    { "eq", _eq, 0 },
+    { "dup", _dup, 0 },
+    { "pop", _pop, 0 },
+    { "true", _true, 0 },
+    { "false", _false, 0 },
+    { "swap", _swap, 0 },
+    { "quote", _quote, 0 },
+    { "if", _if, 0 },
+    { "compose", _compose, 0 },
+    { "test", _test, 0 },
+    { "vec_nil", _vec__nil, 0 },
+    { "vec_push", _vec__push, 0 },
+    { "vec_pop", _vec__pop, 0 },
+    { "vec_count", _vec__count, 0 },
+    { "vec_nth", _vec__nth, 0 },
+    { "vec_set_at", _vec__set__at, 0 },
+    { "vec_slice", _vec__slice, 0 },
+    { "vec_cat", _vec__cat, 0 },
+    { "list_to_vec", _list__to__vec, 0 },
+    { "vec_to_list", _vec__to__list, 0 },
+    { "hash_list", _hash__list, 0 },
+    { "hash_get", _hash__get, 0 },
+    { "hash_set", _hash__set, 0 },
+    { "hash_add", _hash__add, 0 },
+    { "hash_contains", _hash__contains, 0 },
+    { "hash_remove", _hash__remove, 0 },
+    { "hash_count", _hash__count, 0 },
+    { "hash_to_list", _hash__to__list, 0 },
+    { "count", _count, 0 },
+    { "nth", _nth, 0 },
+    { "take", _take, 0 },
+    { "drop", _drop, 0 },
+    { "split_at", _split__at, 0 },
+    { "cat", _cat, 0 },
+    { "rev", _rev, 0 },
+    { "flatten", _flatten, 0 },
+    { "curry", _curry, 0 },
+    { "rcurry", _rcurry, 0 },
+    { "distinct", _distinct, 0 },
+    { "intern", _intern, 0 },
+    { "throw", _throw, 0 },
+    { "try_catch", _try__catch, 0 },
+    { "callcc", _callcc, 0 },
+    { "stats", _stats, 0 },
+    { NULL, NULL, 0 }
+};
+
+// sorted by name, built once by cat_init()
+cat_def** def_index = NULL;
+int def_count = 0;
+std::once_flag def_index_once;
+
+int compare_defs(const void* x, const void* y)
+{
+	return strcmp((*(cat_def**)x)->name, (*(cat_def**)y)->name);
+}
+
+// Builds the name index used by find_def, and turns on hash consing if the 
+// CAT_HASH_CONSING environment variable is set. Called by the functions which
+// use the index, and should be called before forking. Threads may call it at 
+// once, the first does the work and the others wait for it.
+void build_def_index()
+{
+	int n = 0;
+	for (cat_def* p = cat_prim_defs; p->name != NULL; ++p) ++n;
+	for (cat_def* p = cat_lib_defs; p->name != NULL; ++p) ++n;
+	cat_def** index = new cat_def*[n];
+	int count = 0;
+	for (cat_def* p = cat_prim_defs; p->name != NULL; ++p) index[count++] = p;
+	for (cat_def* p = cat_lib_defs; p->name != NULL; ++p) index[count++] = p;
+	qsort(index, count, sizeof(cat_def*), compare_defs);
+	def_index = index;
+	def_count = count;
+	if (getenv("CAT_HASH_CONSING") != NULL)
+		cat_hash_consing = true;
+}
+
+void cat_init()
+{
+	std::call_once(def_index_once, build_def_index);
+}
+
+// Writes the trace to the file given to trace_start, with the names of the
+// definitions. Returns false if tracing wasn't started or the file can't 
+// be written.
+bool trace_stop()
+{
+	if (!cat_tracing.exchange(false))
+		return false;
+	std::vector<std::pair<int, std::string> > names;
+	names.push_back(std::make_pair(trace_def_id(profile_quotation), std::string("[quotation]")));
+	for (cat_def* p = cat_prim_defs; p->name != NULL; ++p) 
+		names.push_back(std::make_pair(trace_def_id(p->fxn), std::string(p->name)));
+	for (cat_def* p = cat_lib_defs; p->name != NULL; ++p) 
+		names.push_back(std::make_pair(trace_def_id(p->fxn), std::string(p->name)));
+	return trace_write_file(trace_path.c_str(), names);
+}
+
+void trace_stop_at_exit()
+{
+	trace_stop();
+}
+
+// Starts recording the calls of all threads, which are written to path by 
+// trace_stop, or else at exit. Calls are only recorded if the program is 
+// built with CAT_TRACE defined.
+void trace_start(const char* path)
+{
+	std::lock_guard<std::mutex> lock(trace_lock);
+	for (trace_ring* r = trace_rings; r != NULL; r = r->next)
+		r->written = 0;
+	trace_path = path;
+	trace_start_ticks = trace_clock();
+	trace_start_ns = trace_nanoseconds();
+	static bool registered = false;
+	if (!registered)
+		atexit(trace_stop_at_exit);
+	registered = true;
+	cat_tracing.store(true);
+}
+
+// Returns the id of a definition, or -1 if it isn't defined. Ids are 
+// stable for a given build of the library.
+int find_def_id(const char* name)
+{
+	cat_init();
+	int lo = 0;
+	int hi = def_count - 1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		int n = strcmp(name, def_index[mid]->name);
+		if (n == 0) 
+			return mid;
+		if (n < 0) 
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return -1;
+}
+
+fxn_ptr def_fxn(int id)
+{
+	cat_init();
+	if (id < 0 || id >= def_count)
+		return NULL;
+	return def_index[id]->fxn;
+}
+
+fxn_ptr find_def(const char* name)
+{
+	return def_fxn(find_def_id(name));
+}
+
+// Returns the named definition of a function, or NULL for anonymous functions.
+const cat_def* find_def_of(fxn_ptr f)
+{
+	cat_init();
+	for (int i=0; i < def_count; ++i)
+		if (def_index[i]->fxn == f)
+			return def_index[i];
+	return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// text evaluation
+
+bool is_int_literal(const char* s)
+{
+	if (*s == '-') ++s;
+	if (*s == '\0') return false;
+	while (*s != '\0')
+		if (*s < '0' || *s++ > '9') return false;
+	return true;
+}
+
+// Evaluates a line of white-space separated integer literals and 
+// definition names. Returns false if a name is not defined, a word is too
+// long, or a literal doesn't fit in an int. The line may come from the 
+// network, so nothing is truncated or left to overflow.
+bool eval_line(const char* s)
+{
+	char tok[256];
+	while (*s != '\0')
+	{
+		while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') ++s;
+		if (*s == '\0') break;
+		size_t n = 0;
+		while (*s != '\0' && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n')
+		{
+			if (n == sizeof(tok) - 1)
+			{
+				printf("word too long\n");
+				return false;
+			}
+			tok[n++] = *s++;
+		}
+		tok[n] = '\0';
+		if (is_int_literal(tok))
+		{
+			errno = 0;
+			long x = strtol(tok, NULL, 10);
+			if (errno == ERANGE || x < INT_MIN || x > INT_MAX)
+			{
+				printf("integer out of range '%s'\n", tok);
+				return false;
+			}
+			push_literal((int)x);
+		}
+		else
+		{
+			fxn_ptr f = find_def(tok);
+			if (f == NULL)
+			{
+				printf("unknown word '%s'\n", tok);
+				return false;
+			}
+			call(f);
+		}
+	}
+	return true;
+}
+
+#endif // CAT_LIB_HPP
@@ -0,0 +1,801 @@
+// Public domain Cat interpreter
+// http://www.cat-language.com
+//
+// Memoization of pure Cat functions. Results are cached in an in-memory LRU
+// table, and optionally in a memory-mapped file which survives restarts of
+// the program. Cache keys contain a hash of the bodies of the memoized
+// definition and of the definitions it calls, so editing any of them 
+// invalidates its entries.
+//
+// There are two ways of memoizing a function:
+// - the "memo" combinator, ('a ('a -> 'b) -> 'b), memoizes a function call
+// - a definition with "memo:" in its meta-data block is compiled to call
+//   memo_call, which caches on all of the arguments of its type declaration.
+//   Definitions from one or two ints to an int use memo_call_int instead, 
+//   which uses a table keyed directly on the integers.
+//
+// The in-memory tables belong to an evaluation context: each thread, and 
+// each context of the C API, has its own.
+//
+// Note that the hash doesn't cover the primitives of the runtime.
+
+#ifndef CAT_MEMO_HPP
+#define CAT_MEMO_HPP
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "cat_lib.hpp"
+#include "..\ootl\ootl_hash.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// value encoding
+
+// Appends an encoding of a value to a key or cached result. Returns false
+// for values which can't be encoded. "stable" is cleared if the encoding
+// is only meaningful inside of this process, such as the address of an
+// anonymous function. The value is only read, so views, deques and interned
+// values on the stack keep their representation.
+bool memo_encode(const object& o, std::string& out, bool& stable);
+
+template<typename T>
+void memo_encode_raw(const T& x, std::string& out)
+{
+	out.append(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+// any kind of list, encoded the same way as a list with the same items
+bool memo_encode_list(const object& o, std::string& out, bool& stable)
+{
+	size_t n = list_count(o);
+	memo_encode_raw((unsigned int)n, out);
+	// bottom to top, so that decoding can push in order
+	for (size_t i=n; i > 0; --i)
+		if (!memo_encode(list_at(o, i - 1), out, stable))
+			return false;
+	return true;
+}
+
+bool memo_encode(const object& o, std::string& out, bool& stable)
+{
+	if (is_list(o))
+	{
+		out += 'l';
+		return memo_encode_list(o, out, stable);
+	}
+	if (o.is<int>())
+	{
+		out += 'i';
+		memo_encode_raw(o.to<int>(), out);
+	}
+	else if (o.is<bool>())
+	{
+		out += o.to<bool>() ? 'T' : 'F';
+	}
+	else if (o.is<double>())
+	{
+		out += 'd';
+		memo_encode_raw(o.to<double>(), out);
+	}
+	else if (o.is<cstring>())
+	{
+		const char* s = o.to<cstring>().to_ptr();
+		out += 's';
+		memo_encode_raw((unsigned int)strlen(s), out);
+		out += s;
+	}
+	else if (o.is<prim_function>())
+	{
+		fxn_ptr f = o.to<prim_function>().fxn;
+		const cat_def* def = find_def_of(f);
+		if (def == NULL)
+		{
+			stable = false;
+			out += 'p';
+			memo_encode_raw(f, out);
+		}
+		else
+		{
+			// library definitions are identified by the hash of their bodies
+			out += 'f';
+			memo_encode_raw((unsigned int)strlen(def->name), out);
+			out += def->name;
+			memo_encode_raw(def->hash, out);
+		}
+	}
+	else if (o.is<quoted_value>())
+	{
+		out += 'q';
+		return memo_encode(o.to<quoted_value>().value, out, stable);
+	}
+	else if (o.is<composed_function>())
+	{
+		// each step as a function or a quotation, which decode to the same
+		// composition when they are composed again
+		const composed_function& cf = o.to<composed_function>();
+		const object* v = cf.values;
+		out += 'c';
+		memo_encode_raw((unsigned int)cf.nsteps, out);
+		for (size_t i=0; i < cf.nsteps; ++i)
+		{
+			if (cf.steps[i] != NULL)
+			{
+				object f = prim_function(cf.steps[i]);
+				if (!memo_encode(f, out, stable))
+					return false;
+			}
+			else
+			{
+				out += 'q';
+				if (!memo_encode(*v++, out, stable))
+					return false;
+			}
+		}
+	}
+	else if (o.is<closure>())
+	{
+		const closure& c = o.to<closure>();
+		object f = prim_function(c.fxn);
+		out += 'k';
+		if (!memo_encode(f, out, stable))
+			return false;
+		memo_encode_raw((unsigned int)c.count, out);
+		for (size_t i=0; i < c.count; ++i)
+			if (!memo_encode(c.values[i], out, stable))
+				return false;
+	}
+	else if (o.is<interned>())
+	{
+		// encoded as the value itself, so it hits the same entries
+		return memo_encode(o.to<interned>().node->value, out, stable);
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+// Strings decoded from the cache, which must outlive the objects referring 
+// to them. When it is full, results containing new strings are not decoded, 
+// and the memoized function is called instead.
+const size_t memo_max_strings = 4096;
+std::unordered_set<std::string> memo_strings;
+std::mutex memo_strings_mutex;
+
+template<typename T>
+bool memo_decode_raw(const char*& p, const char* end, T& x)
+{
+	if (end - p < (ptrdiff_t)sizeof(T))
+		return false;
+	memcpy(&x, p, sizeof(T));
+	p += sizeof(T);
+	return true;
+}
+
+// Decodes a single value, and pushes it on to "out".
+bool memo_decode(const char*& p, const char* end, list& out)
+{
+	if (p >= end)
+		return false;
+	unsigned int n;
+	switch (*p++)
+	{
+		case 'i':
+		{
+			int x;
+			if (!memo_decode_raw(p, end, x)) return false;
+			out.push(x);
+			return true;
+		}
+		case 'T':
+			out.push(true);
+			return true;
+		case 'F':
+			out.push(false);
+			return true;
+		case 'd':
+		{
+			double x;
+			if (!memo_decode_raw(p, end, x)) return false;
+			out.push(x);
+			return true;
+		}
+		case 's':
+		{
+			if (!memo_decode_raw(p, end, n) || end - p < (ptrdiff_t)n) return false;
+			std::lock_guard<std::mutex> lock(memo_strings_mutex);
+			std::string tmp(p, n);
+			std::unordered_set<std::string>::iterator i = memo_strings.find(tmp);
+			if (i == memo_strings.end())
+			{
+				if (memo_strings.size() >= memo_max_strings) return false;
+				i = memo_strings.insert(tmp).first;
+			}
+			const std::string& s = *i;
+			p += n;
+			out.push(cstring(s.c_str()));
+			return true;
+		}
+		case 'l':
+		case 'c':
+		{
+			char tag = p[-1];
+			list items;
+			if (!memo_decode_raw(p, end, n)) return false;
+			while (n-- > 0)
+				if (!memo_decode(p, end, items)) return false;
+			if (tag == 'l')
+			{
+				out.push(items);
+			}
+			else
+			{
+				if (items.count() < 2) return false;
+				object first;
+				object second;
+				items[items.count() - 1].move_to(first);
+				items[items.count() - 2].move_to(second);
+				composed_function cf(first, second);
+				for (size_t i=items.count() - 2; i > 0; --i)
+					cf.compose_with(items[i - 1]);
+				items.clear_nodestroy();
+				out.push(cf);
+			}
+			return true;
+		}
+		case 'q':
+		{
+			list tmp;
+			if (!memo_decode(p, end, tmp)) return false;
+			out.push(quoted_value(tmp.top()));
+			tmp.pop_nodestroy();
+			return true;
+		}
+		case 'k':
+		{
+			list items;
+			if (!memo_decode(p, end, items) || !items.top().is<prim_function>()) return false;
+			if (!memo_decode_raw(p, end, n) || n > closure::max_values) return false;
+			while (n-- > 0)
+				if (!memo_decode(p, end, items)) return false;
+			closure c(items[items.count() - 1].to<prim_function>().fxn);
+			// the last value is bound first, so the first one ends up in front
+			for (size_t i=0; i + 1 < items.count(); ++i)
+				c.bind(items[i]);
+			items.clear_nodestroy();
+			out.push(c);
+			return true;
+		}
+		case 'p':
+		{
+			fxn_ptr f;
+			if (!memo_decode_raw(p, end, f)) return false;
+			out.push(prim_function(f));
+			return true;
+		}
+		case 'f':
+		{
+			if (!memo_decode_raw(p, end, n) || end - p < (ptrdiff_t)n) return false;
+			std::string name(p, n);
+			p += n;
+			unsigned long long hash;
+			if (!memo_decode_raw(p, end, hash)) return false;
+			int id = find_def_id(name.c_str());
+			if (id < 0 || def_index[id]->hash != hash) return false;
+			out.push(prim_function(def_index[id]->fxn));
+			return true;
+		}
+	}
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// in-memory tier
+
+struct memo_lru
+{
+	typedef std::pair<std::string, std::string> entry;
+	typedef std::list<entry>::iterator iterator;
+
+	memo_lru(size_t n)
+		: capacity(n)
+	{ }
+	bool find(const std::string& key, std::string& value)
+	{
+		std::unordered_map<std::string, iterator>::iterator i = index.find(key);
+		if (i == index.end())
+			return false;
+		// move to the front, the most recently used entry
+		entries.splice(entries.begin(), entries, i->second);
+		value = i->second->second;
+		return true;
+	}
+	void add(const std::string& key, const std::string& value)
+	{
+		if (capacity == 0)
+			return;
+		std::unordered_map<std::string, iterator>::iterator i = index.find(key);
+		if (i != index.end())
+		{
+			i->second->second = value;
+			entries.splice(entries.begin(), entries, i->second);
+			return;
+		}
+		while (index.size() >= capacity)
+		{
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+		entries.push_front(entry(key, value));
+		index[key] = entries.begin();
+	}
+	void clear()
+	{
+		index.clear();
+		entries.clear();
+	}
+	size_t capacity;
+	std::list<entry> entries;
+	std::unordered_map<std::string, iterator> index;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// on-disk tier
+
+// A fixed size hash table of fixed size slots in a memory-mapped file.
+// Entries that don't fit in a slot are not stored. Each slot has a checksum,
+// so torn writes from other processes sharing the file are ignored.
+struct memo_disk
+{
+	static const int slot_size = 256;
+	static const int probes = 4;
+
+	struct header
+	{
+		char magic[8];
+		unsigned int slots;
+		unsigned int slot_size;
+	};
+
+	struct slot
+	{
+		unsigned long long key_hash;
+		unsigned long long check;
+		unsigned int key_len;
+		unsigned int value_len;
+		char data[slot_size - 24];
+	};
+
+	memo_disk()
+		: base(NULL), size(0), slots(0)
+	{ }
+	~memo_disk()
+	{
+		close();
+	}
+	bool is_open() const
+	{
+		return base != NULL;
+	}
+	bool open(const char* path, size_t nslots)
+	{
+		close();
+#ifndef _WIN32
+		int fd = ::open(path, O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+			return false;
+		size_t n = sizeof(header) + nslots * sizeof(slot);
+		struct stat st;
+		bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != n;
+		if ((fresh && ftruncate(fd, 0) != 0) || ftruncate(fd, n) != 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void* p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		base = static_cast<char*>(p);
+		size = n;
+		slots = nslots;
+		header* h = reinterpret_cast<header*>(base);
+		if (fresh || memcmp(h->magic, "CATMEMO1", 8) != 0 || h->slots != nslots || h->slot_size != sizeof(slot))
+		{
+			memset(base, 0, size);
+			h->slots = (unsigned int)nslots;
+			h->slot_size = sizeof(slot);
+			memcpy(h->magic, "CATMEMO1", 8);
+		}
+		return true;
+#else
+		return false;
+#endif
+	}
+	void close()
+	{
+#ifndef _WIN32
+		if (base != NULL)
+			munmap(base, size);
+#endif
+		base = NULL;
+		size = 0;
+		slots = 0;
+	}
+	slot* get_slot(size_t n)
+	{
+		return reinterpret_cast<slot*>(base + sizeof(header)) + (n % slots);
+	}
+	static unsigned long long checksum(const slot* s)
+	{
+		unsigned long long h = ootl::fnv_hash(reinterpret_cast<const char*>(&s->key_hash), sizeof(s->key_hash));
+		h = ootl::fnv_hash(reinterpret_cast<const char*>(&s->key_len), sizeof(s->key_len) * 2, h);
+		return ootl::fnv_hash(s->data, s->key_len + s->value_len, h);
+	}
+	bool matches(slot* s, unsigned long long hash, const std::string& key)
+	{
+		return s->key_hash == hash && s->key_len == key.size()
+			&& s->key_len + s->value_len <= sizeof(s->data)
+			&& memcmp(s->data, key.data(), key.size()) == 0
+			&& s->check == checksum(s);
+	}
+	bool find(unsigned long long hash, const std::string& key, std::string& value)
+	{
+		if (!is_open())
+			return false;
+		for (int i=0; i < probes; ++i)
+		{
+			slot* s = get_slot((size_t)hash + i);
+			if (matches(s, hash, key))
+			{
+				value.assign(s->data + s->key_len, s->value_len);
+				return true;
+			}
+		}
+		return false;
+	}
+	void add(unsigned long long hash, const std::string& key, const std::string& value)
+	{
+		if (!is_open() || key.size() + value.size() > sizeof(slot().data))
+			return;
+		// use an empty or matching slot, otherwise replace the first one
+		slot* target = get_slot((size_t)hash);
+		for (int i=0; i < probes; ++i)
+		{
+			slot* s = get_slot((size_t)hash + i);
+			if (s->key_hash == 0 || matches(s, hash, key))
+			{
+				target = s;
+				break;
+			}
+		}
+		target->key_hash = hash;
+		target->key_len = (unsigned int)key.size();
+		target->value_len = (unsigned int)value.size();
+		memcpy(target->data, key.data(), key.size());
+		memcpy(target->data + key.size(), value.data(), value.size());
+		target->check = checksum(target);
+	}
+	char* base;
+	size_t size;
+	size_t slots;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// integer tier
+
+enum memo_eviction
+{
+	// direct mapped, a new entry replaces whatever was in its slot
+	memo_evict_replace,
+	// four way set associative, replaces the least recently used entry of a set
+	memo_evict_lru,
+	// four way set associative, new entries are dropped when their set is full
+	memo_evict_none
+};
+
+// A fixed capacity hash table for definitions which map one or two ints
+// to an int. Lookups need no allocation or encoding, which makes it cheap 
+// enough to put in front of every call of a recursive definition.
+struct memo_int_table
+{
+	struct entry
+	{
+		unsigned long long def;  // zero marks an empty entry
+		int a;
+		int b;
+		int value;
+		unsigned int stamp;
+	};
+
+	memo_int_table(size_t capacity = 65536, memo_eviction e = memo_evict_lru)
+		: entries(NULL), mask(0), ways(1), clock(0), eviction(e)
+	{ 
+		resize(capacity, e);
+	}
+	~memo_int_table()
+	{
+		delete[] entries;
+	}
+	// discards all entries 
+	void resize(size_t capacity, memo_eviction e)
+	{
+		eviction = e;
+		ways = e == memo_evict_replace ? 1 : 4;
+		size_t n = ways;
+		while (n < capacity) 
+			n *= 2;
+		delete[] entries;
+		entries = new entry[n];
+		memset(entries, 0, n * sizeof(entry));
+		mask = (n / ways) - 1;
+		clock = 0;
+	}
+	size_t capacity() const
+	{
+		return (mask + 1) * ways;
+	}
+	entry* get_set(unsigned long long def, int a, int b)
+	{
+		unsigned long long h = def ^ ((unsigned long long)(unsigned int)a * 0x9E3779B97F4A7C15ULL);
+		h ^= (unsigned long long)(unsigned int)b * 0xC2B2AE3D27D4EB4FULL;
+		h ^= h >> 29;
+		return entries + (size_t)(h & mask) * ways;
+	}
+	bool find(unsigned long long def, int a, int b, int& value)
+	{
+		def |= 1;
+		entry* e = get_set(def, a, b);
+		for (int i=0; i < ways; ++i, ++e)
+		{
+			if (e->def == def && e->a == a && e->b == b)
+			{
+				e->stamp = ++clock;
+				value = e->value;
+				return true;
+			}
+		}
+		return false;
+	}
+	void add(unsigned long long def, int a, int b, int value)
+	{
+		def |= 1;
+		entry* set = get_set(def, a, b);
+		entry* target = NULL;
+		for (int i=0; i < ways; ++i)
+		{
+			if (set[i].def == 0 || (set[i].def == def && set[i].a == a && set[i].b == b))
+			{
+				target = set + i;
+				break;
+			}
+			if (target == NULL || set[i].stamp < target->stamp)
+				target = set + i;
+		}
+		if (eviction == memo_evict_none && target->def != 0 && !(target->def == def && target->a == a && target->b == b))
+			return;
+		target->def = def;
+		target->a = a;
+		target->b = b;
+		target->value = value;
+		target->stamp = ++clock;
+	}
+	entry* entries;
+	size_t mask;
+	int ways;
+	unsigned int clock;
+	memo_eviction eviction;
+
+private:
+
+	// hide the copy constructor 
+	memo_int_table(const memo_int_table&) { };
+
+	// hide the assignment operator
+	void operator=(const memo_int_table&) { };
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// the cache
+
+// The in-memory tables of an evaluation context. Every thread has one, and
+// hosts can switch to their own (see memo_set_context).
+struct memo_context
+{
+	memo_context()
+		: general(4096)
+	{ }
+	memo_int_table ints;
+	memo_lru general;
+};
+
+thread_local memo_context memo_thread_context;
+thread_local memo_context* memo_local = NULL;
+
+memo_context& memo_current()
+{
+	return memo_local != NULL ? *memo_local : memo_thread_context;
+}
+
+// Makes the current thread use the given tables, returns the previous 
+// ones. NULL restores the thread's own tables.
+memo_context* memo_set_context(memo_context* x)
+{
+	memo_context* old = memo_local;
+	memo_local = x;
+	return old;
+}
+
+// The disk tier is shared between all threads.
+struct memo_cache
+{
+	bool find(const std::string& key, bool use_disk, std::string& value)
+	{
+		memo_context& local = memo_current();
+		if (local.general.find(key, value))
+			return true;
+		if (!use_disk)
+			return false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!disk.find(hash_key(key), key, value))
+				return false;
+		}
+		local.general.add(key, value);
+		return true;
+	}
+	void add(const std::string& key, const std::string& value, bool use_disk)
+	{
+		memo_current().general.add(key, value);
+		if (!use_disk)
+			return;
+		std::lock_guard<std::mutex> lock(mutex);
+		disk.add(hash_key(key), key, value);
+	}
+	static unsigned long long hash_key(const std::string& key)
+	{
+		// zero marks an empty slot
+		return ootl::fnv_hash(key.data(), key.size()) | 1;
+	}
+	std::mutex mutex;
+	memo_disk disk;
+};
+
+memo_cache memo;
+
+// Opens (or creates) the on-disk cache. Entries are only written to disk by
+// definitions annotated with "memo: disk", and by the memo combinator when
+// it is applied to named functions.
+bool memo_open(const char* path, size_t slots = 65536)
+{
+	std::lock_guard<std::mutex> lock(memo.mutex);
+	return memo.disk.open(path, slots);
+}
+
+// Sets the capacity of the current context's tables, and clears them. 
+// "ints" is the number of entries of the integer table, "general" the number 
+// of entries of the LRU table used for all other arguments. 
+void memo_configure(size_t ints, memo_eviction e, size_t general)
+{
+	memo_context& local = memo_current();
+	local.ints.resize(ints, e);
+	local.general.clear();
+	local.general.capacity = general;
+}
+
+// Replaces the top "n_in" values with the decoded results.
+bool memo_restore(int n_in, const std::string& value)
+{
+	list results;
+	const char* p = value.data();
+	const char* end = p + value.size();
+	while (p < end)
+		if (!memo_decode(p, end, results))
+			return false;
+	for (int i=0; i < n_in; ++i)
+		stk.pop();
+	for (size_t i=results.count(); i > 0; --i)
+	{
+		stk.push_nocreate();
+		results[i - 1].move_to(stk.top());
+	}
+	results.clear_nodestroy();
+	return true;
+}
+
+// Called by the entry point of definitions with "memo:" in their meta-data.
+void memo_call(fxn_ptr f, unsigned long long def_hash, int n_in, int n_out, bool use_disk)
+{
+	std::string key;
+	bool stable = true;
+	memo_encode_raw(def_hash, key);
+	if (stk.count() < (size_t)n_in)
+	{
+		f();
+		return;
+	}
+	for (int i=n_in - 1; i >= 0; --i)
+	{
+		if (!memo_encode(stk[i], key, stable))
+		{
+			f();
+			return;
+		}
+	}
+	std::string value;
+	if (memo.find(key, use_disk && stable, value) && memo_restore(n_in, value))
+		return;
+	f();
+	if (stk.count() < (size_t)n_out)
+		return;
+	for (int i=n_out - 1; i >= 0; --i)
+		if (!memo_encode(stk[i], value, stable))
+			return;
+	memo.add(key, value, use_disk && stable);
+}
+
+// Called by the entry point of memoized definitions which map one or two 
+// ints to an int.
+void memo_call_int(fxn_ptr f, unsigned long long def_hash, int n_in)
+{
+	if (n_in < 1 || n_in > 2 || stk.count() < (size_t)n_in || !stk[0].is<int>() || (n_in == 2 && !stk[1].is<int>()))
+	{
+		f();
+		return;
+	}
+	int a = stk[0].to<int>();
+	int b = n_in == 2 ? stk[1].to<int>() : 0;
+	memo_int_table& table = memo_current().ints;
+	int result;
+	if (table.find(def_hash, a, b, result))
+	{
+		if (n_in == 2)
+			stk.pop();
+		stk.top() = result;
+		return;
+	}
+	f();
+	if (!stk.is_empty() && stk.top().is<int>())
+		table.add(def_hash, a, b, stk.top().to<int>());
+}
+
+// ('a ('a -> 'b) -> 'b)
+void _memo()
+{
+	cat_require(2);
+	object fxn;
+	stk.top().move_to(fxn);
+	stk.pop_nodestroy();
+
+	std::string key("m");
+	bool stable = true;
+	if (!memo_encode(fxn, key, stable) || !memo_encode(stk.top(), key, stable))
+	{
+		_eval(fxn);
+		return;
+	}
+	bool use_disk = stable && memo.disk.is_open();
+	std::string value;
+	if (memo.find(key, use_disk, value) && memo_restore(1, value))
+	{
+		fxn.release();
+		return;
+	}
+	_eval(fxn);
+	if (stk.is_empty() || !memo_encode(stk.top(), value, stable))
+		return;
+	memo.add(key, value, use_disk && stable);
+}
+
+#endif // CAT_MEMO_HPP
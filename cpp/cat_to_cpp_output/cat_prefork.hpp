@@ -0,0 +1,283 @@
+// Public domain Cat interpreter 
+// http://www.cat-language.com
+//
+// A pre-forking server for compiled Cat programs (POSIX only). The runtime and 
+// library are initialized once in the parent process, which then forks a fixed 
+// number of workers. The workers share the initialized pages copy-on-write and 
+// accept connections from a single shared listening socket. 
+// 
+// A request is a single line of integer literals and definition names, and the 
+// response is the resulting stack. A worker that crashes, exceeds its time or 
+// memory limit, or has served its quota of requests exits and is respawned by 
+// the parent. If a fork fails, it is retried with an increasing delay.
+
+#ifndef CAT_PREFORK_HPP
+#define CAT_PREFORK_HPP
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+struct prefork_config
+{
+	prefork_config() 
+		: port(4242), workers(4), max_requests(10000), 
+		  request_timeout(10), max_memory(0), init(cat_init)
+	{ }
+	int port;
+	int workers;
+	// a worker is recycled after this many requests (0 means never)
+	int max_requests;
+	// seconds a client has to send a request before it is dropped, and that 
+	// the request may then run before its worker is killed (0 means never)
+	int request_timeout;
+	// address space limit of each worker in bytes (0 means unlimited)
+	size_t max_memory;
+	// called once in the parent before forking 
+	void (*init)();
+};
+
+volatile sig_atomic_t prefork_stopping = 0;
+
+void prefork_on_stop(int)
+{
+	prefork_stopping = 1;
+}
+
+// Reads up to the first newline. Returns false if the connection was 
+// closed, the line does not fit in the buffer, or it isn't read before 
+// the deadline (0 means never), so a truncated request is never evaluated.
+// Each read must time out on its own, so that the deadline is checked. A 
+// connection carries a single request, so anything after the newline is 
+// ignored.
+bool prefork_read_line(int fd, char* buf, size_t size, time_t deadline)
+{
+	size_t n = 0;
+	while (n < size - 1)
+	{
+		if (deadline != 0 && time(NULL) >= deadline)
+			break;
+		ssize_t r = read(fd, buf + n, size - 1 - n);
+		if (r < 0 && errno == EINTR) 
+			continue;
+		if (r <= 0) 
+			break;
+		char* end = (char*)memchr(buf + n, '\n', r);
+		if (end != NULL) 
+		{
+			*end = '\0';
+			return true;
+		}
+		n += r;
+	}
+	buf[n] = '\0';
+	return false;
+}
+
+// Evaluates a request in the region, the values it makes are all released 
+// at once when it is done.
+struct prefork_request_proc
+{
+	prefork_request_proc(const char* s)
+		: line(s)
+	{ }
+	void operator()()
+	{
+		if (eval_line(line))
+			print_stack();
+		discard_stack();
+	}
+	const char* line;
+};
+
+void prefork_serve_request(int fd, const prefork_config& cfg)
+{
+	// a client which doesn't send its request in time is dropped, so idle
+	// connections can't hold on to the workers
+	time_t deadline = 0;
+	if (cfg.request_timeout > 0)
+	{
+		struct timeval tv;
+		tv.tv_sec = cfg.request_timeout;
+		tv.tv_usec = 0;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		deadline = time(NULL) + cfg.request_timeout;
+	}
+	static char line[65536];
+	if (!prefork_read_line(fd, line, sizeof(line), deadline))
+		return;
+
+	// the response is printed directly to the connection
+	fflush(stdout);
+	int saved_stdout = dup(1);
+	dup2(fd, 1);
+
+	alarm(cfg.request_timeout);
+	try
+	{
+		prefork_request_proc proc(line);
+		run_in_region(proc);
+	}
+	catch (const object::bad_object_cast& e)
+	{
+		printf("type error casting from %s to %s\n", e.from.name(), e.to.name());
+	}
+	catch (cat_exception& e)
+	{
+		printf("uncaught exception: ");
+		print_object(e.data);
+		printf("\n");
+	}
+	alarm(0);
+	stk.clear();
+
+	fflush(stdout);
+	dup2(saved_stdout, 1);
+	close(saved_stdout);
+}
+
+void prefork_worker(int listen_fd, const prefork_config& cfg)
+{
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGINT, SIG_DFL);
+	signal(SIGPIPE, SIG_IGN);
+	// The parent never enables a region, so the worker's region is reserved 
+	// by its first request, within this limit.
+	if (cfg.max_memory > 0)
+	{
+		struct rlimit rl;
+		rl.rlim_cur = rl.rlim_max = cfg.max_memory;
+		setrlimit(RLIMIT_AS, &rl);
+	}
+	for (int n = 0; cfg.max_requests == 0 || n < cfg.max_requests; ++n)
+	{
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED) 
+				continue;
+			_exit(3);
+		}
+		prefork_serve_request(fd, cfg);
+		close(fd);
+	}
+	_exit(0);
+}
+
+pid_t prefork_spawn(int listen_fd, const prefork_config& cfg)
+{
+	// don't let the workers inherit unflushed output
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid == 0)
+		prefork_worker(listen_fd, cfg);
+	if (pid < 0)
+		perror("fork failed");
+	return pid;
+}
+
+// Runs the server until the parent receives SIGINT or SIGTERM. 
+// Returns non-zero if the listening socket could not be created.
+int prefork_serve(const prefork_config& cfg)
+{
+	if (cfg.init != NULL)
+		cfg.init();
+
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+	{
+		perror("socket failed");
+		return 1;
+	}
+	int yes = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons((unsigned short)cfg.port);
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 128) < 0)
+	{
+		perror("bind failed");
+		close(listen_fd);
+		return 1;
+	}
+
+	// no SA_RESTART, so that waitpid is interrupted 
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = prefork_on_stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	// the slots of workers which couldn't be forked are -1
+	pid_t* pids = new pid_t[cfg.workers];
+	for (int i=0; i < cfg.workers; ++i)
+		pids[i] = -1;
+
+	// seconds to wait before retrying failed forks, doubled after each attempt
+	const unsigned int max_backoff = 32;
+	unsigned int backoff = 1;
+
+	while (!prefork_stopping)
+	{
+		int missing = 0;
+		for (int i=0; i < cfg.workers; ++i)
+			if (pids[i] < 0 && (pids[i] = prefork_spawn(listen_fd, cfg)) < 0)
+				++missing;
+		if (missing == 0)
+			backoff = 1;
+
+		// don't block while there are slots to retry
+		int status;
+		pid_t pid = waitpid(-1, &status, missing > 0 ? WNOHANG : 0);
+		if (pid == 0 || (pid < 0 && errno == ECHILD && missing > 0))
+		{
+			// returns early if the parent is signalled to stop
+			sleep(backoff);
+			backoff = backoff * 2 < max_backoff ? backoff * 2 : max_backoff;
+			continue;
+		}
+		if (pid < 0)
+		{
+			if (errno == EINTR) 
+				continue;
+			break;
+		}
+		for (int i=0; i < cfg.workers; ++i)
+		{
+			if (pids[i] != pid) 
+				continue;
+			if (WIFSIGNALED(status))
+				fprintf(stderr, "worker %d killed by signal %d, respawning\n", (int)pid, WTERMSIG(status));
+			else if (WEXITSTATUS(status) != 0)
+				fprintf(stderr, "worker %d exited with %d, respawning\n", (int)pid, WEXITSTATUS(status));
+			pids[i] = prefork_spawn(listen_fd, cfg);
+		}
+	}
+
+	for (int i=0; i < cfg.workers; ++i)
+		if (pids[i] > 0) 
+			kill(pids[i], SIGTERM);
+	for (int i=0; i < cfg.workers; ++i)
+		if (pids[i] > 0) 
+			waitpid(pids[i], NULL, 0);
+	delete[] pids;
+	close(listen_fd);
+	return 0;
+}
+
+#endif // _WIN32
+
+#endif // CAT_PREFORK_HPP
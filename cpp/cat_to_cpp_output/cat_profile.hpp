@@ -0,0 +1,151 @@
+// Public domain Cat interpreter
+// http://www.cat-language.com
+//
+// A sampling profiler for compiled Cat programs (POSIX only). When the
+// program is built with CAT_PROFILE defined, each thread keeps a shadow stack
+// of the definitions it is in (see profile_stack in cat_lib.hpp). A SIGPROF
+// timer copies the shadow stack of the running thread into a sample buffer,
+// by default a thousand times a second of CPU time.
+//
+// When profiling stops the samples are written as folded stacks, one line
+// per distinct stack with its outermost frame first, followed by the number
+// of samples, which is the input of flamegraph.pl and similar tools:
+//
+//   cat;fib;fib;dup 12
+//
+// Definitions are named from the definition tables. Quotations appear as
+// "[quotation]", and functions which aren't in the tables as "[anon]".
+
+#ifndef CAT_PROFILE_HPP
+#define CAT_PROFILE_HPP
+
+#ifndef _WIN32
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <signal.h>
+#include <sys/time.h>
+
+// Each sample is its depth followed by its frames, and a depth of zero ends
+// the buffer. Space is reserved with an atomic add, so the signal handler
+// doesn't need a lock whichever thread it interrupts.
+static const size_t profile_capacity = 1 << 22;
+uintptr_t* profile_buffer = NULL;
+std::atomic<size_t> profile_used(0);
+std::atomic<size_t> profile_dropped(0);
+std::string profile_path;
+
+void profile_signal(int)
+{
+	profile_stack& s = profile_stack::local();
+	size_t depth = s.depth;
+	if (depth == 0)
+		return;
+	if (depth > profile_stack::max_depth)
+		depth = profile_stack::max_depth;
+	size_t pos = profile_used.fetch_add(depth + 1);
+	if (pos + depth + 1 > profile_capacity)
+	{
+		if (pos < profile_capacity)
+			profile_buffer[pos] = 0;
+		++profile_dropped;
+		return;
+	}
+	profile_buffer[pos] = depth;
+	for (size_t i=0; i < depth; ++i)
+		profile_buffer[pos + 1 + i] = (uintptr_t)s.frames[i];
+}
+
+const char* profile_name(fxn_ptr f, const std::unordered_map<fxn_ptr, const char*>& names)
+{
+	if (f == profile_quotation)
+		return "[quotation]";
+	std::unordered_map<fxn_ptr, const char*>::const_iterator i = names.find(f);
+	return i == names.end() ? "[anon]" : i->second;
+}
+
+// Stops sampling and writes the folded stacks. Returns false if the profiler
+// wasn't running or the file can't be written.
+bool profile_stop()
+{
+	if (profile_buffer == NULL)
+		return false;
+	struct itimerval tv;
+	memset(&tv, 0, sizeof(tv));
+	setitimer(ITIMER_PROF, &tv, NULL);
+	signal(SIGPROF, SIG_IGN);
+
+	std::unordered_map<fxn_ptr, const char*> names;
+	for (cat_def* p = cat_prim_defs; p->name != NULL; ++p) names[p->fxn] = p->name;
+	for (cat_def* p = cat_lib_defs; p->name != NULL; ++p) names[p->fxn] = p->name;
+
+	std::map<std::string, size_t> stacks;
+	size_t end = profile_used < profile_capacity ? profile_used.load() : profile_capacity;
+	for (size_t pos=0; pos < end && profile_buffer[pos] != 0; pos += profile_buffer[pos] + 1)
+	{
+		std::string key = "cat";
+		for (size_t i=0; i < profile_buffer[pos]; ++i)
+		{
+			key += ';';
+			key += profile_name((fxn_ptr)profile_buffer[pos + 1 + i], names);
+		}
+		++stacks[key];
+	}
+	free(profile_buffer);
+	profile_buffer = NULL;
+	if (profile_dropped > 0)
+		fprintf(stderr, "profiler: %lu samples dropped, the buffer is full\n", (unsigned long)profile_dropped);
+
+	FILE* f = fopen(profile_path.c_str(), "w");
+	if (f == NULL)
+		return false;
+	for (std::map<std::string, size_t>::iterator i = stacks.begin(); i != stacks.end(); ++i)
+		fprintf(f, "%s %lu\n", i->first.c_str(), (unsigned long)i->second);
+	fclose(f);
+	return true;
+}
+
+void profile_stop_at_exit()
+{
+	profile_stop();
+}
+
+// Starts sampling hz times a second of CPU time. The samples are written to
+// path when profile_stop is called, or else at exit. The shadow stacks are
+// only kept if the program is built with CAT_PROFILE defined.
+bool profile_start(const char* path, int hz = 1000)
+{
+	if (profile_buffer != NULL || hz <= 0)
+		return false;
+	profile_buffer = (uintptr_t*)malloc(profile_capacity * sizeof(uintptr_t));
+	if (profile_buffer == NULL)
+		return false;
+	profile_path = path;
+	profile_used = 0;
+	profile_dropped = 0;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = profile_signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGPROF, &sa, NULL);
+
+	struct itimerval tv;
+	tv.it_interval.tv_sec = 0;
+	tv.it_interval.tv_usec = hz >= 1000000 ? 1 : 1000000 / hz;
+	tv.it_value = tv.it_interval;
+	setitimer(ITIMER_PROF, &tv, NULL);
+
+	static bool registered = false;
+	if (!registered)
+		atexit(profile_stop_at_exit);
+	registered = true;
+	return true;
+}
+
+#endif // _WIN32
+
+#endif // CAT_PROFILE_HPP
@@ -0,0 +1,233 @@
+// Public domain Cat interpreter
+// http://www.cat-language.com
+//
+// Runtime statistics, which are kept when the program is built with
+// CAT_STATS defined. Besides the counters of objects and containers (see
+// ootl_stats.hpp), each thread counts the functions it evaluates by kind,
+// the compositions and quotations it makes, and the deepest its data stack
+// has been at a call.
+//
+// The totals of all threads are pushed as a hash list by the "stats"
+// primitive. Once stats_install is called they are also written as JSON at
+// exit and on SIGUSR1, to the file named by CAT_STATS_FILE or else to
+// stderr. The JSON is made without allocating, so it can be written from
+// the signal handler.
+
+#ifndef CAT_STATS_HPP
+#define CAT_STATS_HPP
+
+#include <fcntl.h>
+#include <signal.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "..\ootl\ootl_stats.hpp"
+
+enum eval_kind
+{
+	eval_prim, eval_quotation, eval_composition, eval_closure, eval_interned,
+	eval_continuation, eval_kinds
+};
+
+const char* eval_kind_names[eval_kinds] = {
+	"prim", "quotation", "composition", "closure", "interned", "continuation"
+};
+
+// the counters of one thread, kept like those of ootl::stats
+struct cat_stats
+{
+	size_t evals[eval_kinds];
+	size_t compositions;
+	size_t quotations;
+	size_t max_depth;
+	cat_stats* next;
+
+	static cat_stats& local()
+	{
+		static thread_local cat_stats* p = NULL;
+		if (p == NULL)
+			p = add_thread();
+		return *p;
+	}
+
+	static cat_stats*& first()
+	{
+		static cat_stats* p = NULL;
+		return p;
+	}
+
+	// adds up the counters of all threads, the depth is the deepest of any
+	static void total(cat_stats& x)
+	{
+		memset(&x, 0, sizeof(x));
+		for (cat_stats* p = first(); p != NULL; p = p->next)
+		{
+			for (int i=0; i < eval_kinds; ++i)
+				x.evals[i] += p->evals[i];
+			x.compositions += p->compositions;
+			x.quotations += p->quotations;
+			if (p->max_depth > x.max_depth)
+				x.max_depth = p->max_depth;
+		}
+	}
+
+	static int thread_count()
+	{
+		int n = 0;
+		for (cat_stats* p = first(); p != NULL; p = p->next)
+			++n;
+		return n;
+	}
+
+private:
+
+	static cat_stats* add_thread()
+	{
+		static std::mutex m;
+		cat_stats* p = (cat_stats*)calloc(1, sizeof(cat_stats));
+		std::lock_guard<std::mutex> guard(m);
+		p->next = first();
+		first() = p;
+		return p;
+	}
+};
+
+void stats_depth(size_t depth)
+{
+	cat_stats& s = cat_stats::local();
+	if (depth > s.max_depth)
+		s.max_depth = depth;
+}
+
+// appends to a fixed buffer, which is cut short if it is full
+struct json_writer
+{
+	json_writer()
+		: n(0), first(true)
+	{ }
+	void raw(const char* s)
+	{
+		while (*s != '\0' && n < sizeof(buf))
+			buf[n++] = *s++;
+	}
+	void number(size_t x)
+	{
+		char tmp[24];
+		int i = 0;
+		do
+		{
+			tmp[i++] = (char)('0' + x % 10);
+			x /= 10;
+		}
+		while (x > 0);
+		while (i > 0 && n < sizeof(buf))
+			buf[n++] = tmp[--i];
+	}
+	void key(const char* k)
+	{
+		raw(first ? "\n  \"" : ",\n  \"");
+		raw(k);
+		raw("\": ");
+		first = false;
+	}
+	void field(const char* k, size_t x)
+	{
+		key(k);
+		number(x);
+	}
+	char buf[16384];
+	size_t n;
+	bool first;
+};
+
+// the names in an object are written on one line
+void json_counts(json_writer& w, const char* k, const char* const* names, const size_t* counts, size_t n)
+{
+	w.key(k);
+	w.raw("{");
+	for (size_t i=0; i < n; ++i)
+	{
+		w.raw(i == 0 ? "\"" : ", \"");
+		w.raw(names[i]);
+		w.raw("\": ");
+		w.number(counts[i]);
+	}
+	w.raw("}");
+}
+
+void stats_write_json(int fd)
+{
+	ootl::stats o;
+	ootl::stats::total(o);
+	cat_stats c;
+	cat_stats::total(c);
+	const char* type_names[ootl::stats::max_types];
+	size_t ntypes = ootl::stats::type_count();
+	for (size_t i=0; i < ntypes; ++i)
+		type_names[i] = ootl::stats::type_name(i);
+
+	json_writer w;
+	w.raw("{");
+	w.field("threads", cat_stats::thread_count());
+	json_counts(w, "objects_created", type_names, o.objects_created, ntypes);
+	w.field("payload_bytes_allocated", o.payload_bytes_allocated);
+	w.field("payload_bytes_freed", o.payload_bytes_freed);
+	w.field("buffers_added", o.buffers_added);
+	w.field("buffers_removed", o.buffers_removed);
+	json_counts(w, "evals", eval_kind_names, c.evals, eval_kinds);
+	w.field("compositions", c.compositions);
+	w.field("quotations", c.quotations);
+	w.field("max_stack_depth", c.max_depth);
+	w.raw("\n}\n");
+	write(fd, w.buf, (unsigned int)w.n);
+}
+
+// read by stats_install, the environment isn't read from a signal handler
+char stats_path[256];
+
+void stats_write_file()
+{
+	if (stats_path[0] == '\0')
+	{
+		stats_write_json(2);
+		return;
+	}
+	int fd = open(stats_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return;
+	stats_write_json(fd);
+	close(fd);
+}
+
+#ifndef _WIN32
+void stats_signal(int)
+{
+	stats_write_file();
+}
+#endif
+
+// writes the statistics at exit, and on SIGUSR1
+void stats_install()
+{
+	static bool installed = false;
+	if (installed)
+		return;
+	installed = true;
+	const char* path = getenv("CAT_STATS_FILE");
+	if (path != NULL)
+		strncpy(stats_path, path, sizeof(stats_path) - 1);
+	atexit(stats_write_file);
+#ifndef _WIN32
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stats_signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+#endif
+}
+
+#endif // CAT_STATS_HPP
@@ -0,0 +1,201 @@
+// Public domain Cat interpreter
+// http://www.cat-language.com
+//
+// A binary event tracer for compiled Cat programs. When the program is built
+// with CAT_TRACE defined and tracing is started, each call records when it
+// is entered and left, with the depth of the data stack and the type of its
+// top value. Records are 16 bytes and go into a ring buffer of the calling
+// thread, so recording takes no lock, and when a ring wraps the newest
+// records are kept.
+//
+// The rings are written to a file when tracing stops, which can be read
+// with cat_trace_decode. A trace file holds:
+// - a trace_file_header
+// - name_count entries of an int (a definition id), an unsigned int length,
+//   and that many characters of its name
+// - ring_count rings of an unsigned int thread number, an unsigned int
+//   record count, and that many trace_records, oldest first
+//
+// All of it is in the byte order of the machine that wrote it.
+
+#ifndef CAT_TRACE_HPP
+#define CAT_TRACE_HPP
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum trace_event
+{
+	trace_enter = 1,
+	trace_exit = 2
+};
+
+// the type of the value on top of the stack
+enum trace_tag
+{
+	tag_empty, tag_int, tag_bool, tag_double, tag_string, tag_list,
+	tag_function, tag_vector, tag_hash_list, tag_other
+};
+
+struct trace_record
+{
+	// in ticks of trace_clock
+	unsigned long long time;
+	// the address of the function relative to trace_base, which the name
+	// table of the file maps to a name
+	int def;
+	// the count of the data stack, at most 65535
+	unsigned short depth;
+	unsigned char tag;
+	unsigned char event;
+};
+
+struct trace_file_header
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int record_size;
+	// trace_clock when tracing started, and its ticks per nanosecond
+	unsigned long long start;
+	double ticks_per_ns;
+	unsigned int name_count;
+	unsigned int ring_count;
+};
+
+static const char trace_magic[8] = { 'C', 'A', 'T', 'T', 'R', 'A', 'C', 'E' };
+static const unsigned int trace_version = 1;
+
+// the time stamp counter where there is one, it is much cheaper to read than
+// the system clocks
+unsigned long long trace_clock()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+unsigned long long trace_nanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// definition ids are relative to this function, so they fit in an int
+void trace_base()
+{ }
+
+int trace_def_id(void (*f)())
+{
+	return (int)((intptr_t)f - (intptr_t)trace_base);
+}
+
+// A ring is allocated by its thread when it first records, and is kept
+// after the thread exits so that its records are written out.
+struct trace_ring
+{
+	static const size_t capacity = 1 << 16;
+
+	trace_ring(unsigned int n)
+		: thread(n), written(0), next(NULL)
+	{
+		records = new trace_record[capacity];
+	}
+
+	unsigned int thread;
+	trace_record* records;
+	// the number of records ever written, the oldest kept is at written - capacity
+	unsigned long long written;
+	trace_ring* next;
+};
+
+// set while tracing, checked before each call with relaxed ordering, since 
+// it may be started or stopped from any thread
+std::atomic<bool> cat_tracing(false);
+
+std::mutex trace_lock;
+trace_ring* trace_rings = NULL;
+unsigned int trace_ring_count = 0;
+thread_local trace_ring* trace_local_ring = NULL;
+unsigned long long trace_start_ticks = 0;
+unsigned long long trace_start_ns = 0;
+std::string trace_path;
+
+trace_ring* trace_add_ring()
+{
+	std::lock_guard<std::mutex> lock(trace_lock);
+	trace_ring* r = new trace_ring(++trace_ring_count);
+	r->next = trace_rings;
+	trace_rings = r;
+	trace_local_ring = r;
+	return r;
+}
+
+void trace_write_record(int def, unsigned char event, size_t depth, unsigned char tag)
+{
+	trace_ring* r = trace_local_ring;
+	if (r == NULL)
+		r = trace_add_ring();
+	trace_record& x = r->records[r->written & (trace_ring::capacity - 1)];
+	x.time = trace_clock();
+	x.def = def;
+	x.depth = depth > 65535 ? 65535 : (unsigned short)depth;
+	x.tag = tag;
+	x.event = event;
+	++r->written;
+}
+
+// Writes the rings and the names of the definitions. The other threads
+// should not be recording, records being written when the ring is copied
+// may be torn.
+bool trace_write_file(const char* path, const std::vector<std::pair<int, std::string> >& names)
+{
+	FILE* f = fopen(path, "wb");
+	if (f == NULL)
+		return false;
+	std::lock_guard<std::mutex> lock(trace_lock);
+	trace_file_header h;
+	memcpy(h.magic, trace_magic, sizeof(h.magic));
+	h.version = trace_version;
+	h.record_size = sizeof(trace_record);
+	h.start = trace_start_ticks;
+	unsigned long long ns = trace_nanoseconds() - trace_start_ns;
+	h.ticks_per_ns = ns == 0 ? 1.0 : (double)(trace_clock() - trace_start_ticks) / (double)ns;
+	h.name_count = (unsigned int)names.size();
+	h.ring_count = trace_ring_count;
+	fwrite(&h, sizeof(h), 1, f);
+	for (size_t i=0; i < names.size(); ++i)
+	{
+		unsigned int len = (unsigned int)names[i].second.size();
+		fwrite(&names[i].first, sizeof(int), 1, f);
+		fwrite(&len, sizeof(len), 1, f);
+		fwrite(names[i].second.c_str(), 1, len, f);
+	}
+	for (trace_ring* r = trace_rings; r != NULL; r = r->next)
+	{
+		unsigned long long first = r->written > trace_ring::capacity ? r->written - trace_ring::capacity : 0;
+		unsigned int count = (unsigned int)(r->written - first);
+		fwrite(&r->thread, sizeof(r->thread), 1, f);
+		fwrite(&count, sizeof(count), 1, f);
+		for (unsigned long long i = first; i < r->written; ++i)
+			fwrite(&r->records[i & (trace_ring::capacity - 1)], sizeof(trace_record), 1, f);
+	}
+	bool ok = ferror(f) == 0;
+	fclose(f);
+	return ok;
+}
+
+#endif // CAT_TRACE_HPP
@@ -0,0 +1,130 @@
+// Public domain Cat interpreter
+// http://www.cat-language.com
+//
+// Prints a trace file written by the tracer of the Cat runtime (see
+// cat_trace.hpp).
+//
+//   cat_trace_decode trace_file         prints every record, indented by call depth
+//   cat_trace_decode -summary trace_file  prints the calls and time of each definition
+
+#include <stdlib.h>
+#include <map>
+
+#include "cat_trace.hpp"
+
+const char* tag_names[] = {
+	"empty", "int", "bool", "double", "string", "list",
+	"function", "vector", "hash_list", "other"
+};
+
+std::map<int, std::string> names;
+
+std::string def_name(int def)
+{
+	std::map<int, std::string>::iterator i = names.find(def);
+	if (i != names.end())
+		return i->second;
+	char buf[32];
+	sprintf(buf, "[anon %+d]", def);
+	return buf;
+}
+
+template<typename T>
+bool read_value(FILE* f, T& x)
+{
+	return fread(&x, sizeof(T), 1, f) == 1;
+}
+
+struct def_summary
+{
+	def_summary()
+		: calls(0), ticks(0)
+	{ }
+	unsigned long long calls;
+	// inclusive of the definitions it calls
+	unsigned long long ticks;
+};
+
+int main(int argc, char* argv[])
+{
+	bool summary = argc == 3 && strcmp(argv[1], "-summary") == 0;
+	if (argc != 2 && !summary)
+	{
+		fprintf(stderr, "usage: cat_trace_decode [-summary] trace_file\n");
+		return 1;
+	}
+	FILE* f = fopen(argv[argc - 1], "rb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "can't open %s\n", argv[argc - 1]);
+		return 1;
+	}
+	trace_file_header h;
+	if (!read_value(f, h) || memcmp(h.magic, trace_magic, sizeof(h.magic)) != 0
+		|| h.version != trace_version || h.record_size != sizeof(trace_record))
+	{
+		fprintf(stderr, "not a trace file of this version\n");
+		return 1;
+	}
+	for (unsigned int i=0; i < h.name_count; ++i)
+	{
+		int def;
+		unsigned int len;
+		if (!read_value(f, def) || !read_value(f, len))
+			return 1;
+		std::string s(len, ' ');
+		if (len > 0 && fread(&s[0], 1, len, f) != len)
+			return 1;
+		names[def] = s;
+	}
+
+	std::map<std::string, def_summary> defs;
+	for (unsigned int i=0; i < h.ring_count; ++i)
+	{
+		unsigned int thread, count;
+		if (!read_value(f, thread) || !read_value(f, count))
+			return 1;
+		if (!summary)
+			printf("thread %u, %u records\n", thread, count);
+		// the calls entered and not yet left, the ring may start inside some
+		std::vector<trace_record> entered;
+		for (unsigned int j=0; j < count; ++j)
+		{
+			trace_record r;
+			if (!read_value(f, r))
+				return 1;
+			const char* tag = r.tag < sizeof(tag_names) / sizeof(tag_names[0]) ? tag_names[r.tag] : "?";
+			if (r.event == trace_exit && !entered.empty())
+			{
+				if (summary)
+				{
+					def_summary& d = defs[def_name(entered.back().def)];
+					++d.calls;
+					d.ticks += r.time - entered.back().time;
+				}
+				entered.pop_back();
+			}
+			if (!summary)
+			{
+				double us = (double)(long long)(r.time - h.start) / h.ticks_per_ns / 1000.0;
+				printf("%14.3f us %*s%c %s  (depth %u, %s)\n", us, (int)entered.size() * 2, "",
+					r.event == trace_enter ? '>' : '<', def_name(r.def).c_str(), r.depth, tag);
+			}
+			if (r.event == trace_enter)
+				entered.push_back(r);
+		}
+	}
+	fclose(f);
+
+	if (summary)
+	{
+		printf("%-24s %12s %14s %12s\n", "definition", "calls", "total us", "mean ns");
+		for (std::map<std::string, def_summary>::iterator i = defs.begin(); i != defs.end(); ++i)
+		{
+			double ns = i->second.ticks / h.ticks_per_ns;
+			printf("%-24s %12llu %14.1f %12.1f\n", i->first.c_str(), i->second.calls,
+				ns / 1000.0, ns / i->second.calls);
+		}
+	}
+	return 0;
+}
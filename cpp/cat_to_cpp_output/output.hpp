@@ -508,12 +508,6 @@ void _neqz()
     push_literal(0 );
     call(_neq);
 }
-void _curry()
-{
-    push_function(_cat_anon36); //[quote]
-    call(_dip);
-    call(_compose);
-}
 void _curry2()
 {
     call(_curry);
@@ -524,11 +518,6 @@ void _rcompose()
     call(_swap);
     call(_compose);
 }
-void _rcurry()
-{
-    call(_swap);
-    call(_curry);
-}
 void _for()
 {
     call(_swap);
@@ -587,25 +576,11 @@ void _whilenz()
     call(_while);
     call(_pop);
 }
-void _cat()
-{
-    call(_rev);
-    call(_swap);
-    push_function(_cat_anon48); //[cons]
-    call(_fold);
-}
 void _consd()
 {
     push_function(_cat_anon49); //[cons]
     call(_dip);
 }
-void _count()
-{
-    call(_dup);
-    push_literal(0 );
-    push_function(_cat_anon50); //[pop inc]
-    call(_fold);
-}
 void _count__while()
 {
     push_function(_cat_anon51); //[dup 0 swap]
@@ -617,11 +592,6 @@ void _count__while()
     call(_while);
     call(_pop);
 }
-void _drop()
-{
-    push_function(_cat_anon56); //[[tail] dip dec]
-    call(_whilenz);
-}
 void _drop__while()
 {
     call(_count__while);
@@ -645,13 +615,6 @@ void _first()
     call(_uncons);
     call(_popd);
 }
-void _flatten()
-{
-    call(_rev);
-    call(_nil);
-    push_function(_cat_anon62); //[cat]
-    call(_fold);
-}
 void _fold()
 {
     call(_swapd);
@@ -711,24 +674,12 @@ void _n()
     call(_swap);
     call(_for);
 }
-void _nth()
-{
-    call(_dupd);
-    call(_drop);
-    call(_head);
-}
 void _pair()
 {
     push_function(_cat_anon70); //[unit]
     call(_dip);
     call(_cons);
 }
-void _rev()
-{
-    call(_nil);
-    push_function(_cat_anon71); //[cons]
-    call(_fold);
-}
 void _rmap()
 {
     call(_nil);
@@ -760,15 +711,6 @@ void _split()
     call(_compose);
     call(_filter);
 }
-void _split__at()
-{
-    call(_nil);
-    call(_bury);
-    push_function(_cat_anon76); //[move_head]
-    call(_swap);
-    call(_repeat);
-    call(_swap);
-}
 void _swons()
 {
     call(_swap);
@@ -779,15 +721,6 @@ void _tail()
     call(_uncons);
     call(_pop);
 }
-void _take()
-{
-    call(_nil);
-    call(_bury);
-    push_function(_cat_anon78); //[[move_head] dip dec]
-    call(_whilenz);
-    call(_pop);
-    call(_rev);
-}
 void _take__while()
 {
     call(_count__while);
@@ -1560,9 +1493,7 @@ void _cat_anon94()
 }
 void _cat_anon95()
 {
-    push_function(_cat_anon93); //[1]
-    push_function(_cat_anon94); //[inc]
-    call(_compose);
+    push_closure(_cat_anon94, 1); //[inc]
     call(_apply);
     push_literal(2 );
     call(_eq);
@@ -1889,9 +1820,7 @@ void _cat_anon140()
 void _cat_anon141()
 {
     push_literal(1 );
-    push_literal(2 );
-    push_function(_cat_anon140); //[add_int]
-    call(_curry);
+    push_closure(_cat_anon140, 2 ); //[add_int]
     call(_apply);
     push_literal(3 );
     call(_eq);
@@ -1935,9 +1864,7 @@ void _cat_anon147()
 void _cat_anon148()
 {
     push_literal(1 );
-    push_function(_cat_anon147); //[add_int]
-    push_literal(2 );
-    call(_rcurry);
+    push_closure(_cat_anon147, 2 ); //[add_int]
     call(_apply);
     push_literal(3 );
     call(_eq);
@@ -2680,3 +2607,93 @@ void _cat_anon230()
     push_literal(5 );
     call(_lteq__int);
 }
+cat_def cat_lib_defs[] = {
+    { "apply", _apply, 0x71ee0622446dade9ULL },
+    { "apply2", _apply2, 0xe9007830e7f5caf2ULL },
+    { "dip", _dip, 0x489848a0af635002ULL },
+    { "dip2", _dip2, 0x7fd30d9866225b7aULL },
+    { "b", _b, 0x3a1450036dd0eaf7ULL },
+    { "c", _c, 0x8ff3a19bab027b91ULL },
+    { "d", _d, 0x663e82a055c94777ULL },
+    { "i", _i, 0xabcfd9fbbb03883aULL },
+    { "k", _k, 0xe2e9ae61b925c763ULL },
+    { "ki", _ki, 0xe7d690bb37a31457ULL },
+    { "l", _l, 0xac1534ec06024267ULL },
+    { "m", _m, 0xeab2885eba6ce82eULL },
+    { "o", _o, 0xe78500bb375dc87fULL },
+    { "r", _r, 0x3da3a3360c692f45ULL },
+    { "s", _s, 0x408af5c3fe9280cdULL },
+    { "t", _t, 0xe7bba0bb378c67cfULL },
+    { "u", _u, 0x0088dccd7fde1d7eULL },
+    { "v", _v, 0x058deb430bcf0ec2ULL },
+    { "w", _w, 0x77ad829c00947fa5ULL },
+    { "y", _y, 0xe2fb62b73944d9a4ULL },
+    { "and", _and, 0xea6043d62c173861ULL },
+    { "nand", _nand, 0x1f118ad3973b603dULL },
+    { "nor", _nor, 0x3d317a2d30ed93d7ULL },
+    { "not", _not, 0xe5273d227f06d94dULL },
+    { "or", _or, 0xb42491e8c0915eadULL },
+    { "eqz", _eqz, 0x23e7d3e01975c224ULL },
+    { "eqf", _eqf, 0x784d25d73987b215ULL },
+    { "neq", _neq, 0xc739fff8a7ad9f6aULL },
+    { "neqf", _neqf, 0xf1040972d7e3dbe1ULL },
+    { "neqz", _neqz, 0x13bf19f538722ce2ULL },
+    { "curry2", _curry2, 0xa5b7dffa0cec4ff5ULL },
+    { "rcompose", _rcompose, 0xd22a5ed8f116e376ULL },
+    { "for", _for, 0xb3b6e98d86f00ab4ULL },
+    { "for_each", _for__each, 0x9fed40e83680f3e6ULL },
+    { "repeat", _repeat, 0xf9ef092e3522640cULL },
+    { "rfor", _rfor, 0x0833090cd2b908ccULL },
+    { "whilen", _whilen, 0x4e8691d5522b4e21ULL },
+    { "whilene", _whilene, 0xd841a1a8a7b5cebdULL },
+    { "whilenz", _whilenz, 0x5445e7d54f7193efULL },
+    { "consd", _consd, 0xdf83a2a44948aba9ULL },
+    { "count_while", _count__while, 0x953085aa48f55e94ULL },
+    { "drop_while", _drop__while, 0xa56445067a832a59ULL },
+    { "filter", _filter, 0x1247307a6a06f59cULL },
+    { "first", _first, 0x19d4eb6819cfa7cfULL },
+    { "fold", _fold, 0xf8c1e9366f0e60fbULL },
+    { "gen", _gen, 0x8116dd8892978b4aULL },
+    { "head", _head, 0xcc5c402207ac399cULL },
+    { "last", _last, 0x10c17c3aeb07c136ULL },
+    { "map", _map, 0x78a8d270f3aa6c34ULL },
+    { "mid", _mid, 0xb288d2dae898501bULL },
+    { "move_head", _move__head, 0xf5143086b586d77bULL },
+    { "n", _n, 0xa22e16acfba1fc86ULL },
+    { "pair", _pair, 0x194d18c7b86e398dULL },
+    { "rmap", _rmap, 0x7d219390d41007ffULL },
+    { "set_at", _set__at, 0xcf6e66f5ed61f1c3ULL },
+    { "small", _small, 0x992287f59615c1efULL },
+    { "split", _split, 0xac4327994b5643bcULL },
+    { "swons", _swons, 0x904fbb7176cfef7dULL },
+    { "tail", _tail, 0x7c88c9b5ed2f0648ULL },
+    { "take_while", _take__while, 0x6b927e1e570a92afULL },
+    { "triple", _triple, 0x86cb00d9f7268387ULL },
+    { "unpair", _unpair, 0x61a6a84d1b0f150aULL },
+    { "unit", _unit, 0xd562a60ecb012280ULL },
+    { "bury", _bury, 0x65c029912fdc51e1ULL },
+    { "dig", _dig, 0xdcd991909b94b037ULL },
+    { "dup2", _dup2, 0x8f21253710a14675ULL },
+    { "dupd", _dupd, 0x3b085957ec6a3ae1ULL },
+    { "over", _over, 0x9c0dcb8978a5de3fULL },
+    { "peek", _peek, 0x6048fba6fbbf49bbULL },
+    { "poke", _poke, 0x81db6a3826f8b7b6ULL },
+    { "pop2", _pop2, 0x429547f0c5159d75ULL },
+    { "pop3", _pop3, 0x7d390f7a902d98a0ULL },
+    { "popd", _popd, 0xe2e9ae61b925c763ULL },
+    { "swap2", _swap2, 0xeae032a9084c06c8ULL },
+    { "swapd", _swapd, 0x69d7ea1fe4dd4ad7ULL },
+    { "under", _under, 0xdf200d27b0d379c9ULL },
+    { "dec", _dec, 0xe533877717ee8bacULL },
+    { "even", _even, 0x2681bf1cf7fbd388ULL },
+    { "inc", _inc, 0xc9aa1ddb74f04f33ULL },
+    { "sub_int", _sub__int, 0xf4c7442f6aab6ca2ULL },
+    { "min_int", _min__int, 0xf053e66ea52c072aULL },
+    { "max_int", _max__int, 0x507775ff8f6b4e18ULL },
+    { "odd", _odd, 0x4ca17a5e3461d727ULL },
+    { "gt_int", _gt__int, 0xddd3c8dec73a3170ULL },
+    { "gteq_int", _gteq__int, 0xa26a56ae5f3758ceULL },
+    { "lteq_int", _lteq__int, 0xec0f9a1ad619b83aULL },
+    { "run_tests", _run__tests, 0xc8ab88aa87d124a0ULL },
+    { NULL, NULL, 0 }
+};
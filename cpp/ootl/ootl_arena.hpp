@@ -0,0 +1,420 @@
+// Public Domain
+// http://www.ootl.org
+//
+// An arena hands out memory by bumping a pointer through large chunks, and
+// frees all of it at once when it is reset. Freeing a single allocation
+// does nothing. This suits containers which are built up and then thrown
+// away together, for example the temporary stacks of a computation.
+//
+// The arena_vlist_policy allocates the buffers of a vlist (and so of a
+// stack) from the arena of the current thread. Such containers must be
+// destroyed before the arena is reset.
+//
+// A region is an arena made of a single reserved range of addresses, so 
+// whether a block belongs to it is known from the block's address. Each 
+// thread has one, which is allocated from only while it is enabled. This 
+// lets code which doesn't know about regions, like the OOTL containers and 
+// ootl::object, allocate through region_allocate and free through 
+// region_deallocate: blocks of the region are only reclaimed when it is 
+// reset, other blocks come from and go back to the heap. Values allocated 
+// from a region must not be used once it is reset.
+//
+// The regions of all threads are reserved from one range of addresses, so
+// a block of any thread's region is recognized, and left alone, when it is
+// freed by another thread or after its thread has exited. The range is 
+// reserved when a region is first enabled, and counts against RLIMIT_AS, so 
+// it is made smaller to fit within half of that limit. A process which 
+// limits its address space, like a pre-forked worker, should do so before 
+// enabling a region.
+
+#ifndef OOTL_ARENA_HPP
+#define OOTL_ARENA_HPP
+
+#include <atomic>
+#include <mutex>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "ootl_vlist.hpp"
+
+namespace ootl
+{
+	struct arena
+	{
+		static const size_t chunk_size = 1 << 16;
+		static const size_t alignment = 16;
+
+		arena()
+			: mChunk(NULL), mPos(NULL), mEnd(NULL), mUsed(0)
+		{ }
+		~arena()
+		{
+			reset();
+		}
+
+		void* allocate(size_t bytes)
+		{
+			bytes = (bytes + alignment - 1) & ~(alignment - 1);
+			if (bytes > (size_t)(mEnd - mPos))
+				add_chunk(bytes);
+			void* p = mPos;
+			mPos += bytes;
+			mUsed += bytes;
+			return p;
+		}
+
+		// releases everything allocated from the arena
+		void reset()
+		{
+			while (mChunk != NULL)
+			{
+				chunk* tmp = mChunk;
+				mChunk = mChunk->prev;
+				free(tmp);
+			}
+			mPos = NULL;
+			mEnd = NULL;
+			mUsed = 0;
+		}
+
+		// the number of bytes allocated since the last reset
+		size_t used() const
+		{
+			return mUsed;
+		}
+
+		// the arena of the current thread
+		static arena& current()
+		{
+			static thread_local arena a;
+			return a;
+		}
+
+	private:
+
+		// a chunk header is followed by its memory
+		struct chunk
+		{
+			chunk* prev;
+			size_t size;
+		};
+
+		static size_t header_size()
+		{
+			return (sizeof(chunk) + alignment - 1) & ~(alignment - 1);
+		}
+
+		void add_chunk(size_t bytes)
+		{
+			size_t n = bytes > chunk_size ? bytes : chunk_size;
+			chunk* c = (chunk*)malloc(header_size() + n);
+			if (c == NULL)
+				throw std::bad_alloc();
+			c->prev = mChunk;
+			c->size = n;
+			mChunk = c;
+			mPos = (char*)c + header_size();
+			mEnd = mPos + n;
+		}
+
+		// hide the copy constructor
+		arena(const arena&) { };
+
+		// hide the assignment operator
+		void operator=(const arena&) { };
+
+		//////////////////////////////////////////////////////
+		// fields
+
+		chunk* mChunk;
+		char* mPos;
+		char* mEnd;
+		size_t mUsed;
+	};
+
+	struct region
+	{
+		// the address space reserved by each thread's region, unless the 
+		// address space limit calls for less, but no less than min_reserve_size
+		static const size_t reserve_size = (size_t)1 << 28;
+		static const size_t min_reserve_size = (size_t)1 << 20;
+		static const size_t alignment = 16;
+		// the number of threads which can have a region at the same time, 
+		// the threads after that allocate from the heap
+		static const size_t max_regions = sizeof(void*) >= 8 ? 64 : 4;
+
+		// The region of the current thread. It has no constructor, so it is
+		// zero initialized without any cost on each access.
+		static region& local()
+		{
+			static thread_local region r;
+			return r;
+		}
+
+		// Allocations from the heap are used while the region is disabled.
+		// Returns false, and leaves it disabled, if no addresses could be 
+		// reserved for it (see why_unavailable).
+		bool enable()
+		{
+			if (mBase == NULL)
+				reserve();
+			mEnabled = mBase != NULL;
+			return mEnabled;
+		}
+		void disable()
+		{
+			mEnabled = false;
+		}
+		bool is_enabled() const
+		{
+			return mEnabled;
+		}
+
+		// returns NULL if the region is full
+		void* allocate(size_t bytes)
+		{
+			bytes = (bytes + alignment - 1) & ~(alignment - 1);
+			if (bytes > (size_t)(mEnd - mPos))
+			{
+				mOverflowed = true;
+				return NULL;
+			}
+			void* p = mPos;
+			mPos += bytes;
+			return p;
+		}
+		bool owns(const void* p) const
+		{
+			return p >= mBase && p < mEnd;
+		}
+		// true if p belongs to the region of any thread
+		static bool owned_by_any(const void* p)
+		{
+			const address_space* s = reserved_space().load(std::memory_order_acquire);
+			return s != NULL && p >= s->base && p < s->base + s->slots * s->slot_size;
+		}
+
+		// why the last enable failed, or NULL if the region is reserved
+		const char* why_unavailable() const
+		{
+			return mBase != NULL ? NULL : mWhy;
+		}
+
+		// true if an allocation didn't fit since the last reset, which means 
+		// some values made while the region was enabled are on the heap
+		bool overflowed() const
+		{
+			return mOverflowed;
+		}
+
+		// releases everything allocated from the region in O(1)
+		void reset()
+		{
+			mPos = mBase;
+			mOverflowed = false;
+		}
+
+		// the number of bytes allocated since the last reset
+		size_t used() const
+		{
+			return mPos - mBase;
+		}
+
+	private:
+
+		// The addresses of the regions of all threads, divided into slots. 
+		// It is never unmapped, since blocks of a region may be freed after 
+		// its thread has exited. 
+		struct address_space
+		{
+			address_space()
+				: base(NULL), slot_size(reserve_size), slots(max_regions), why(NULL)
+			{
+				memset(used, 0, sizeof(used));
+#ifndef _WIN32
+				struct rlimit rl;
+				if (getrlimit(RLIMIT_AS, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+				{
+					// fewer slots first, then smaller ones
+					size_t limit = (size_t)(rl.rlim_cur / 2);
+					while (slots * slot_size > limit && slots > 1)
+						slots /= 2;
+					while (slot_size > limit && slot_size > min_reserve_size)
+						slot_size /= 2;
+					if (slot_size > limit)
+					{
+						why = "the address space limit is too small";
+						return;
+					}
+				}
+				// pages are only committed when they are first touched
+				void* p = mmap(NULL, slots * slot_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+				if (p == MAP_FAILED)
+				{
+					why = "the address space could not be reserved";
+					return;
+				}
+				base = (char*)p;
+				reserved_space().store(this, std::memory_order_release);
+#else
+				why = "regions are not supported on Windows";
+#endif
+			}
+			char* base;
+			size_t slot_size;
+			size_t slots;
+			const char* why;
+			bool used[max_regions];
+			std::mutex mutex;
+		};
+
+		// constructed by the first reserve
+		static address_space& space()
+		{
+			static address_space s;
+			return s;
+		}
+
+		// set once the address space is reserved, so that freeing a block 
+		// before then doesn't reserve it
+		static std::atomic<const address_space*>& reserved_space()
+		{
+			static std::atomic<const address_space*> p;
+			return p;
+		}
+
+		// gives the slot back when the thread exits
+		struct unreserve
+		{
+			unreserve(region& x) : r(x) { }
+			~unreserve()
+			{
+				address_space& s = space();
+#ifndef _WIN32
+				// the pages are released, the addresses are kept
+				madvise(r.mBase, s.slot_size, MADV_DONTNEED);
+#endif
+				std::lock_guard<std::mutex> lock(s.mutex);
+				s.used[(r.mBase - s.base) / s.slot_size] = false;
+				r.mBase = r.mPos = r.mEnd = NULL;
+			}
+			region& r;
+		};
+
+		void reserve()
+		{
+			address_space& s = space();
+			if (s.base == NULL)
+			{
+				mWhy = s.why;
+				return;
+			}
+			std::lock_guard<std::mutex> lock(s.mutex);
+			for (size_t i=0; i < s.slots; ++i)
+			{
+				if (!s.used[i])
+				{
+					s.used[i] = true;
+					mBase = mPos = s.base + i * s.slot_size;
+					mEnd = mBase + s.slot_size;
+					static thread_local unreserve u(*this);
+					return;
+				}
+			}
+			mWhy = "the regions of other threads use every slot";
+		}
+
+		//////////////////////////////////////////////////////
+		// fields
+
+		char* mBase;
+		char* mPos;
+		char* mEnd;
+		const char* mWhy;
+		bool mEnabled;
+		bool mOverflowed;
+	};
+
+	// allocates from the thread's region if it is enabled, or else from the heap
+	inline void* region_allocate(size_t bytes)
+	{
+		region& r = region::local();
+		if (r.is_enabled())
+		{
+			void* p = r.allocate(bytes);
+			if (p != NULL)
+				return p;
+		}
+		return ::operator new(bytes);
+	}
+
+	// frees a block from region_allocate, blocks of any region are left alone
+	inline void region_deallocate(void* p)
+	{
+		if (!region::owned_by_any(p))
+			::operator delete(p);
+	}
+
+	// a standard allocator which uses region_allocate
+	template<typename T>
+	struct region_allocator
+	{
+		typedef T value_type;
+
+		region_allocator() { }
+		template<typename U>
+		region_allocator(const region_allocator<U>&) { }
+
+		T* allocate(size_t n) { return (T*)region_allocate(n * sizeof(T)); }
+		void deallocate(T* p, size_t) { region_deallocate(p); }
+
+		template<typename U>
+		bool operator==(const region_allocator<U>&) const { return true; }
+		template<typename U>
+		bool operator!=(const region_allocator<U>&) const { return false; }
+	};
+
+	// Allocates the buffers of a vlist from the thread's region while it is 
+	// enabled, and otherwise as Base_T does.
+	template<typename Base_T>
+	struct region_vlist_policy : Base_T
+	{
+		static void* allocate(size_t bytes, bool zero)
+		{
+			region& r = region::local();
+			if (r.is_enabled())
+			{
+				void* p = r.allocate(bytes);
+				if (p != NULL)
+				{
+					if (zero)
+						memset(p, 0, bytes);
+					return p;
+				}
+			}
+			return Base_T::allocate(bytes, zero);
+		}
+		static void deallocate(void* p, size_t bytes)
+		{
+			if (!region::owned_by_any(p))
+				Base_T::deallocate(p, bytes);
+		}
+	};
+
+	struct arena_vlist_policy : default_vlist_policy
+	{
+		static void* allocate(size_t bytes, bool zero)
+		{
+			void* p = arena::current().allocate(bytes);
+			if (zero)
+				memset(p, 0, bytes);
+			return p;
+		}
+		static void deallocate(void*, size_t)
+		{ }
+	};
+}
+
+#endif
@@ -0,0 +1,173 @@
+// Public Domain
+// http://www.ootl.org
+//
+// A double-ended queue built from two ootl::stack objects placed back to
+// back: the top of one is the front of the deque and the top of the other
+// is its back. Since each stack is a vlist, the deque grows in both
+// directions by adding buffers of doubling size, and items never move
+// while it grows. Pushing and popping at either end is O(1). When one end
+// runs out of items, half of the items at the other end are moved over, so
+// popping is amortized O(1) even when alternating between the ends.
+//
+// Items are relocated with memcpy when they are moved between stacks, so
+// T must not hold a pointer to itself.
+
+#ifndef OOTL_DEQUE_HPP
+#define OOTL_DEQUE_HPP
+
+#include <cstring>
+
+#include "ootl_stack.hpp"
+
+namespace ootl
+{
+	template<typename T, typename Policy_T = default_vlist_policy>
+	struct deque
+	{
+		//////////////////////////////////////////////////////
+		// public type defs
+
+		typedef deque self;
+		typedef T value_type;
+
+		//////////////////////////////////////////////////////
+		// constructor/destructors
+
+		deque()
+		{ }
+		deque(const self& x)
+			: mFront(x.mFront), mBack(x.mBack)
+		{ }
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Indexable concept
+		//
+		// Note: deque[0] is the front
+
+		T& operator[](size_t n) {
+			if (n < mFront.count())
+				return mFront[n];
+			return mBack[count() - 1 - n];
+		}
+		const T& operator[](size_t n) const {
+			if (n < mFront.count())
+				return mFront[n];
+			return mBack[count() - 1 - n];
+		}
+		size_t count() const {
+			return mFront.count() + mBack.count();
+		}
+		bool is_empty() const {
+			return count() == 0;
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Deque concept
+
+		void push_front(const T& x) {
+			mFront.push(x);
+		}
+		void push_back(const T& x) {
+			mBack.push(x);
+		}
+		void pop_front() {
+			ootl_assert(!is_empty());
+			if (mFront.count() == 0)
+				rebalance(mBack, mFront);
+			mFront.pop();
+		}
+		void pop_back() {
+			ootl_assert(!is_empty());
+			if (mBack.count() == 0)
+				rebalance(mFront, mBack);
+			mBack.pop();
+		}
+		T& front() {
+			ootl_assert(!is_empty());
+			if (mFront.count() == 0)
+				rebalance(mBack, mFront);
+			return mFront.top();
+		}
+		T& back() {
+			ootl_assert(!is_empty());
+			if (mBack.count() == 0)
+				rebalance(mFront, mBack);
+			return mBack.top();
+		}
+		void clear() {
+			mFront.clear();
+			mBack.clear();
+		}
+		// exchanges the contents of two deques in constant time
+		void swap(self& x) {
+			mFront.swap(x.mFront);
+			mBack.swap(x.mBack);
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Iterable concept
+		//
+		// Items are visited from the front to the back.
+
+		template<typename Procedure>
+		void foreach(Procedure& proc) const {
+			for (size_t i=0; i < count(); ++i)
+				proc(operator[](i));
+		}
+
+		bool operator==(const self& x) const
+		{
+			if (count() != x.count())
+				return false;
+			for (size_t i=0; i < count(); ++i)
+				if (!(operator[](i) == x[i]))
+					return false;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation functions
+
+		// The top of the front stack is the front of the deque.
+		stack<T, Policy_T>& get_front_stack() {
+			return mFront;
+		}
+		// The top of the back stack is the back of the deque.
+		stack<T, Policy_T>& get_back_stack() {
+			return mBack;
+		}
+
+	private:
+
+		static void relocate(stack<T, Policy_T>& from, stack<T, Policy_T>& to) {
+			to.push_nocreate();
+			memcpy((void*)&to.top(), (const void*)&from.top(), sizeof(T));
+			from.pop_nodestroy();
+		}
+
+		// moves the bottom half of "from" (the items nearest the other end)
+		// onto the empty stack "to"
+		static void rebalance(stack<T, Policy_T>& from, stack<T, Policy_T>& to) {
+			ootl_assert(to.count() == 0);
+			size_t keep = from.count() / 2;
+			stack<T, Policy_T> tmp;
+			while (tmp.count() < keep)
+				relocate(from, tmp);
+			while (from.count() > 0)
+				relocate(from, to);
+			while (tmp.count() > 0)
+				relocate(tmp, from);
+		}
+
+		// hide the assignment operator
+		void operator=(const self& x) { };
+
+		//////////////////////////////////////////////////////////////
+		// fields
+
+		stack<T, Policy_T> mFront;
+		stack<T, Policy_T> mBack;
+	};
+}
+
+#endif
@@ -0,0 +1,442 @@
+// Public Domain
+// http://www.ootl.org
+//
+// A persistent hash map, implemented as a hash array mapped trie (HAMT).
+// Each level of the trie consumes 5 bits of the hash code, and a node
+// stores its entries and its sub-nodes in two arrays, sized exactly, which
+// are indexed by the population count of two 32-bit bitmaps. Get, set and
+// remove are O(log32 n) and an updated map shares all of its unchanged
+// nodes with the original.
+//
+// Like ootl::pvector, nodes are reference counted and a node referenced by
+// a single version is updated in place. This makes any map which isn't
+// shared behave as a transient: building or updating a map in a loop
+// allocates only when a node grows, and never copies the map. Reference
+// counts are not atomic. Nodes and their arrays are allocated from the 
+// thread's region while it is enabled (see ootl_arena.hpp).
+
+#ifndef OOTL_HAMT_HPP
+#define OOTL_HAMT_HPP
+
+#include "ootl_hash.hpp"
+#include "ootl_arena.hpp"
+
+namespace ootl
+{
+	// compares keys, and values, with operator==
+	struct equal_values {
+	  template<typename T>
+	  bool operator()(const T& x, const T& y) const {
+		return x == y;
+	  }
+	};
+
+	// Keys which are equal must have the same hash code. The values of two 
+	// tries are compared with equal_T as well.
+	template<typename key_T, typename value_T, typename hash_T = hasher<key_T>, typename equal_T = equal_values>
+	struct hamt
+	{
+		//////////////////////////////////////////////////////
+		// typedefs and constants
+
+		typedef hamt self;
+
+		static const int bits = 5;
+		static const unsigned int mask = (1 << bits) - 1;
+
+		// nodes below this level hold colliding entries in no particular order
+		static const int max_shift = 30;
+
+		struct entry
+		{
+			static void* operator new[](size_t n) { return region_allocate(n); }
+			static void operator delete[](void* p) { region_deallocate(p); }
+			unsigned int hash;
+			key_T key;
+			value_T value;
+		};
+
+		//////////////////////////////////////////////////////
+		// node data structure
+
+		struct node
+		{
+			static void* operator new(size_t n) { return region_allocate(n); }
+			static void operator delete(void* p) { region_deallocate(p); }
+			node()
+				: refs(1), datamap(0), nodemap(0), nentries(0), nkids(0), entries(NULL), kids(NULL)
+			{ }
+			node(const node& x)
+				: refs(1), datamap(x.datamap), nodemap(x.nodemap), nentries(x.nentries), nkids(x.nkids), entries(NULL), kids(NULL)
+			{
+				if (nentries > 0)
+				{
+					entries = new entry[nentries];
+					for (size_t i=0; i < nentries; ++i)
+						entries[i] = x.entries[i];
+				}
+				if (nkids > 0)
+				{
+					kids = new_kids(nkids);
+					for (size_t i=0; i < nkids; ++i)
+					{
+						kids[i] = x.kids[i];
+						++kids[i]->refs;
+					}
+				}
+			}
+			~node()
+			{
+				for (size_t i=0; i < nkids; ++i)
+					release(kids[i]);
+				delete[] entries;
+				delete_kids(kids);
+			}
+			int refs;
+			unsigned int datamap;
+			unsigned int nodemap;
+			size_t nentries;
+			size_t nkids;
+			entry* entries;
+			node** kids;
+		};
+
+		//////////////////////////////////////////////////////
+		// constructor/destructors
+
+		hamt()
+			: root(NULL), cnt(0)
+		{ }
+		hamt(const self& x)
+			: root(x.root), cnt(x.cnt)
+		{
+			if (root != NULL)
+				++root->refs;
+		}
+		~hamt()
+		{
+			release(root);
+		}
+		self& operator=(const self& x)
+		{
+			if (x.root != NULL)
+				++x.root->refs;
+			release(root);
+			root = x.root;
+			cnt = x.cnt;
+			return *this;
+		}
+
+		//////////////////////////////////////////////////////
+		// public functions
+
+		size_t count() const
+		{
+			return cnt;
+		}
+		bool is_empty() const
+		{
+			return cnt == 0;
+		}
+
+		// returns NULL if the key is not found
+		const value_T* find(const key_T& key) const
+		{
+			unsigned int h = hash(key);
+			const node* p = root;
+			for (int shift = 0; p != NULL; shift += bits)
+			{
+				if (shift > max_shift)
+				{
+					for (size_t i=0; i < p->nentries; ++i)
+						if (same_key(p->entries[i].key, key))
+							return &p->entries[i].value;
+					return NULL;
+				}
+				unsigned int bit = 1u << ((h >> shift) & mask);
+				if (p->datamap & bit)
+				{
+					const entry& e = p->entries[index(p->datamap, bit)];
+					if (e.hash == h && same_key(e.key, key))
+						return &e.value;
+					return NULL;
+				}
+				if (!(p->nodemap & bit))
+					return NULL;
+				p = p->kids[index(p->nodemap, bit)];
+			}
+			return NULL;
+		}
+		bool contains(const key_T& key) const
+		{
+			return find(key) != NULL;
+		}
+
+		// associates a value with a key, replacing any previous value
+		void set(const key_T& key, const value_T& value)
+		{
+			entry e;
+			e.hash = hash(key);
+			e.key = key;
+			e.value = value;
+			if (assoc(root, 0, e))
+				++cnt;
+		}
+
+		// returns false if the key is not found
+		bool remove(const key_T& key)
+		{
+			if (!contains(key))
+				return false;
+			dissoc(root, 0, hash(key), key);
+			--cnt;
+			return true;
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Iterable concept
+		//
+		// The procedure is called with each entry, in no particular order.
+
+		template<typename Procedure>
+		void foreach(Procedure& proc) const
+		{
+			foreach(root, proc);
+		}
+
+		bool operator==(const self& x) const
+		{
+			if (count() != x.count())
+				return false;
+			if (root == x.root)
+				return true;
+			equals_proc proc(x);
+			foreach(proc);
+			return proc.result;
+		}
+
+	private:
+
+		//////////////////////////////////////////////////////
+		// implementation functions
+
+		static unsigned int hash(const key_T& key)
+		{
+			static hash_T hasher;
+			return static_cast<unsigned int>(hasher(key));
+		}
+
+		static bool same_key(const key_T& x, const key_T& y)
+		{
+			return equal_T()(x, y);
+		}
+
+		static size_t count_bits(unsigned int x)
+		{
+			x = x - ((x >> 1) & 0x55555555);
+			x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+			x = (x + (x >> 4)) & 0x0F0F0F0F;
+			return (x * 0x01010101) >> 24;
+		}
+
+		// position of the bit in an array indexed by the bitmap
+		static size_t index(unsigned int bitmap, unsigned int bit)
+		{
+			return count_bits(bitmap & (bit - 1));
+		}
+
+		static void release(node* p)
+		{
+			if (p != NULL && --p->refs == 0)
+				delete p;
+		}
+
+		// returns a node which only this version refers to
+		static node* make_unique(node* p)
+		{
+			if (p == NULL)
+				return new node();
+			if (p->refs == 1)
+				return p;
+			--p->refs;
+			return new node(*p);
+		}
+
+		static node** new_kids(size_t n)
+		{
+			return (node**)region_allocate(n * sizeof(node*));
+		}
+		static void delete_kids(node** p)
+		{
+			if (p != NULL)
+				region_deallocate(p);
+		}
+
+		static void insert_entry(node* p, size_t i, const entry& e)
+		{
+			entry* tmp = new entry[p->nentries + 1];
+			for (size_t j=0; j < i; ++j)
+				tmp[j] = p->entries[j];
+			tmp[i] = e;
+			for (size_t j=i; j < p->nentries; ++j)
+				tmp[j + 1] = p->entries[j];
+			delete[] p->entries;
+			p->entries = tmp;
+			++p->nentries;
+		}
+
+		static void remove_entry(node* p, size_t i)
+		{
+			entry* tmp = p->nentries > 1 ? new entry[p->nentries - 1] : NULL;
+			for (size_t j=0; j < i; ++j)
+				tmp[j] = p->entries[j];
+			for (size_t j=i + 1; j < p->nentries; ++j)
+				tmp[j - 1] = p->entries[j];
+			delete[] p->entries;
+			p->entries = tmp;
+			--p->nentries;
+		}
+
+		static void insert_kid(node* p, size_t i, node* kid)
+		{
+			node** tmp = new_kids(p->nkids + 1);
+			for (size_t j=0; j < i; ++j)
+				tmp[j] = p->kids[j];
+			tmp[i] = kid;
+			for (size_t j=i; j < p->nkids; ++j)
+				tmp[j + 1] = p->kids[j];
+			delete_kids(p->kids);
+			p->kids = tmp;
+			++p->nkids;
+		}
+
+		static void remove_kid(node* p, size_t i)
+		{
+			node** tmp = p->nkids > 1 ? new_kids(p->nkids - 1) : NULL;
+			for (size_t j=0; j < i; ++j)
+				tmp[j] = p->kids[j];
+			for (size_t j=i + 1; j < p->nkids; ++j)
+				tmp[j - 1] = p->kids[j];
+			delete_kids(p->kids);
+			p->kids = tmp;
+			--p->nkids;
+		}
+
+		// returns true if a new entry was added
+		static bool assoc(node*& p, int shift, const entry& e)
+		{
+			p = make_unique(p);
+			if (shift > max_shift)
+			{
+				for (size_t i=0; i < p->nentries; ++i)
+				{
+					if (same_key(p->entries[i].key, e.key))
+					{
+						p->entries[i].value = e.value;
+						return false;
+					}
+				}
+				insert_entry(p, p->nentries, e);
+				return true;
+			}
+			unsigned int bit = 1u << ((e.hash >> shift) & mask);
+			if (p->datamap & bit)
+			{
+				size_t i = index(p->datamap, bit);
+				entry& x = p->entries[i];
+				if (x.hash == e.hash && same_key(x.key, e.key))
+				{
+					x.value = e.value;
+					return false;
+				}
+				// push both entries down into a new sub-node
+				node* kid = NULL;
+				assoc(kid, shift + bits, x);
+				assoc(kid, shift + bits, e);
+				remove_entry(p, i);
+				p->datamap ^= bit;
+				insert_kid(p, index(p->nodemap, bit), kid);
+				p->nodemap |= bit;
+				return true;
+			}
+			if (p->nodemap & bit)
+				return assoc(p->kids[index(p->nodemap, bit)], shift + bits, e);
+			insert_entry(p, index(p->datamap, bit), e);
+			p->datamap |= bit;
+			return true;
+		}
+
+		// the key must be in the map
+		static void dissoc(node*& p, int shift, unsigned int h, const key_T& key)
+		{
+			p = make_unique(p);
+			if (shift > max_shift)
+			{
+				for (size_t i=0; i < p->nentries; ++i)
+				{
+					if (same_key(p->entries[i].key, key))
+					{
+						remove_entry(p, i);
+						return;
+					}
+				}
+				return;
+			}
+			unsigned int bit = 1u << ((h >> shift) & mask);
+			if (p->datamap & bit)
+			{
+				remove_entry(p, index(p->datamap, bit));
+				p->datamap ^= bit;
+				return;
+			}
+			size_t i = index(p->nodemap, bit);
+			dissoc(p->kids[i], shift + bits, h, key);
+			node* kid = p->kids[i];
+			if (kid->nkids == 0 && kid->nentries == 1)
+			{
+				// move a lone entry back up into this node
+				entry e = kid->entries[0];
+				remove_kid(p, i);
+				p->nodemap ^= bit;
+				release(kid);
+				insert_entry(p, index(p->datamap, bit), e);
+				p->datamap |= bit;
+			}
+		}
+
+		template<typename Procedure>
+		static void foreach(const node* p, Procedure& proc)
+		{
+			if (p == NULL)
+				return;
+			for (size_t i=0; i < p->nentries; ++i)
+				proc(p->entries[i]);
+			for (size_t i=0; i < p->nkids; ++i)
+				foreach(p->kids[i], proc);
+		}
+
+		struct equals_proc
+		{
+			equals_proc(const self& x)
+				: other(x), result(true)
+			{ }
+			void operator()(const entry& e)
+			{
+				if (!result)
+					return;
+				const value_T* v = other.find(e.key);
+				result = v != NULL && equal_T()(*v, e.value);
+			}
+			const self& other;
+			bool result;
+		};
+
+		//////////////////////////////////////////////////////
+		// fields
+
+		node* root;
+		size_t cnt;
+	};
+}
+
+#endif
@@ -4,6 +4,8 @@
 #ifndef OOTL_HASH_HPP
 #define OOTL_HASH_HPP
 
+#include <cassert>
+
 #include "ootl_stack.hpp"
 
 namespace ootl
@@ -12,6 +14,7 @@ namespace ootl
 typedef unsigned char u1;
 typedef unsigned short u2;
 typedef unsigned long u4;
+typedef unsigned long long u8;
 
 #define get16bits(d) (*((const u2*)(d)))
 
@@ -64,6 +67,19 @@ u4 hseih_hash(const char* key, u4 len)
 
 #undef get16bits
 
+// 64-bit FNV-1a hash, from http://www.isthe.com/chongo/tech/comp/fnv/
+// The result is the same on every platform, so it can be used for 
+// identifiers that are written to disk. Pass a previous result as 
+// "hash" to continue hashing.
+u8 fnv_hash(const char* key, size_t len, u8 hash = 14695981039346656037ULL)
+{
+  while (len-- > 0) {
+    hash ^= (u1)*key++;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
 	template<typename T>
 	struct hasher {
 	  u4 operator()(const T& x) const { 
@@ -168,6 +184,27 @@ u4 hseih_hash(const char* key, u4 len)
 			return find_slot(hash(key), key, get_last_buffer())->mSecond;
 		}
 
+		// returns NULL if the key isn't in the map, where operator[] throws
+		value_T* find(const key_T& key)
+		{
+			u4 hash_code = hash(key);
+			for (buffer* buff = get_last_buffer(); buff != NULL; buff = buff->prev)
+			{
+				size_t nIndex = hash_code % buff->size;
+				size_t nStep = 1;
+				hash_pair* p = &(buff->begin[nIndex]);
+				while (p->mFirst != unused_key)
+				{
+					if (p->mFirst == key)
+						return &p->mSecond;
+					nIndex = (nIndex + (nStep * nStep)) % buff->size;
+					p = &(buff->begin[nIndex]);
+					++nStep;
+				}
+			}
+			return NULL;
+		}
+
 	private:
 
 		// Hide the copy constructor
@@ -8,6 +8,8 @@
 #include <memory>
 
 #include "ootl_string.hpp"
+#include "ootl_arena.hpp"
+#include "ootl_stats.hpp"
 
 namespace ootl
 {  
@@ -58,10 +60,16 @@ namespace ootl
 			static void  destructor(holder& x) { cast(x)->~T();  }
 			static void  deleter(holder& x) { destructor(x); x.pointer = NULL; }
 			static bool  equals(const holder& x, const holder& y) { return *cast(x) == *cast(y); }
-			static void  clone(holder& x, const holder& y) {  new(x.buffer) T(*cast(y)); }
+			static void  clone(holder& x, const holder& y) {  
+				new(x.buffer) T(*cast(y)); 
+#ifdef OOTL_STATS
+				++stats::local().objects_created[stats::type_index<T>()];
+#endif
+			}
 		};
 
-		// static functions for unoptimized types (pointed to by holder::pointer)
+		// static functions for unoptimized types (pointed to by holder::pointer), 
+		// which are allocated from the thread's region while it is enabled
 		template<typename T>
 		struct fxns<T, false> 
 		{
@@ -72,9 +80,22 @@ namespace ootl
 			static void* get_ptr(holder& x) { return x.pointer; } 
 			static const void* get_const_ptr(const holder& x) { return x.pointer; } 
 			static void  destructor(holder& x) { cast(x)->~T(); }
-			static void  deleter(holder& x) { delete(cast(x)); }
+			static void  deleter(holder& x) { 
+				destructor(x); 
+				region_deallocate(x.pointer); 
+#ifdef OOTL_STATS
+				stats::local().payload_bytes_freed += sizeof(T);
+#endif
+			}
 			static bool  equals(const holder& x, const holder& y) { return *cast(x) == *cast(y); }
-			static void  clone(holder& x, const holder& y) { x.pointer = new T(*cast(y)); }
+			static void  clone(holder& x, const holder& y) { 
+				x.pointer = new(region_allocate(sizeof(T))) T(*cast(y)); 
+#ifdef OOTL_STATS
+				stats& s = stats::local();
+				++s.objects_created[stats::type_index<T>()];
+				s.payload_bytes_allocated += sizeof(T);
+#endif
+			}
 		};  
 		
 		// this creates a function pointer table which points to functions for dealing with
@@ -134,7 +155,13 @@ namespace ootl
 			if (sizeof(T) <= buffer_size) 
 				new(held.buffer) T(x);
 			else 
-				held.pointer = new T(x); 
+				held.pointer = new(region_allocate(sizeof(T))) T(x); 
+#ifdef OOTL_STATS
+			stats& s = stats::local();
+			++s.objects_created[stats::type_index<T>()];
+			if (sizeof(T) > buffer_size) 
+				s.payload_bytes_allocated += sizeof(T);
+#endif
 		}
 		object& assign(const object& x) {
 			release();
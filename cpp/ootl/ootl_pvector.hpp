@@ -0,0 +1,299 @@
+// Public Domain
+// http://www.ootl.org
+//
+// A persistent vector: an immutable indexable collection where "modifying"
+// operations return a new version which shares all unchanged nodes with
+// the old one. It is implemented as a 32-way trie, so indexing, setting,
+// appending and slicing are O(log32 n), which is effectively constant.
+//
+// Nodes are reference counted. When a node is referenced by only one
+// version it is updated in place instead of being copied, so building a
+// vector by appending to it, which is the common case, doesn't copy.
+// Reference counts are not atomic: a version must not be copied
+// concurrently from several threads. Nodes are allocated from the thread's
+// region while it is enabled (see ootl_arena.hpp).
+
+#ifndef OOTL_PVECTOR_HPP
+#define OOTL_PVECTOR_HPP
+
+#include <cstdlib>
+
+#include "ootl_arena.hpp"
+
+namespace ootl
+{
+	template<typename T>
+	struct pvector
+	{
+		//////////////////////////////////////////////////////
+		// typedefs and constants
+
+		typedef pvector self;
+		typedef T value_type;
+
+		static const int bits = 5;
+		static const size_t width = 1 << bits;
+		static const size_t mask = width - 1;
+
+		//////////////////////////////////////////////////////
+		// node data structures
+
+		struct node
+		{
+			node() : refs(1) { }
+			static void* operator new(size_t n) { return region_allocate(n); }
+			static void operator delete(void* p) { region_deallocate(p); }
+			int refs;
+		};
+
+		struct branch : node
+		{
+			branch()
+			{
+				for (size_t i=0; i < width; ++i)
+					kids[i] = NULL;
+			}
+			node* kids[width];
+		};
+
+		struct leaf : node
+		{
+			T items[width];
+		};
+
+		//////////////////////////////////////////////////////
+		// constructor/destructors
+
+		pvector()
+			: root(NULL), shift(0), offset(0), cnt(0)
+		{ }
+		pvector(const self& x)
+			: root(x.root), shift(x.shift), offset(x.offset), cnt(x.cnt)
+		{
+			if (root != NULL)
+				++root->refs;
+		}
+		~pvector()
+		{
+			release(root, shift);
+		}
+		self& operator=(const self& x)
+		{
+			if (x.root != NULL)
+				++x.root->refs;
+			release(root, shift);
+			root = x.root;
+			shift = x.shift;
+			offset = x.offset;
+			cnt = x.cnt;
+			return *this;
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Indexable concept
+		//
+		// Note: unlike ootl::stack, index 0 is the first item appended
+
+		const T& operator[](size_t n) const
+		{
+			ootl_assert(n < cnt);
+			return get_leaf(offset + n)->items[(offset + n) & mask];
+		}
+		const T& get_at(size_t n) const
+		{
+			return operator[](n);
+		}
+		void set_at(size_t n, const T& x)
+		{
+			ootl_assert(n < cnt);
+			assoc(offset + n) = x;
+		}
+		size_t count() const
+		{
+			return cnt;
+		}
+		bool is_empty() const
+		{
+			return cnt == 0;
+		}
+
+		//////////////////////////////////////////////////////
+		// growing and shrinking
+
+		void push(const T& x)
+		{
+			size_t n = offset + cnt;
+			if (root != NULL && n >= (width << shift))
+			{
+				// add a level on top of the current root
+				branch* b = new branch();
+				b->kids[0] = root;
+				root = b;
+				shift += bits;
+			}
+			assoc(n) = x;
+			++cnt;
+		}
+		void pop()
+		{
+			ootl_assert(cnt > 0);
+			// release the item, so the vector doesn't keep it alive
+			set_at(cnt - 1, T());
+			--cnt;
+		}
+		const T& top() const
+		{
+			return operator[](cnt - 1);
+		}
+
+		//////////////////////////////////////////////////////
+		// slicing and concatenation
+
+		// Returns the items from "first" up to but not including "last",
+		// sharing all of their nodes.
+		self slice(size_t first, size_t last) const
+		{
+			ootl_assert(first <= last && last <= cnt);
+			self ret(*this);
+			ret.offset += first;
+			ret.cnt = last - first;
+			ret.trim();
+			return ret;
+		}
+
+		// Appends the items of another vector, this is O(m log n) where
+		// m is the number of items in x.
+		void concat(const self& x)
+		{
+			size_t n = x.count();
+			for (size_t i=0; i < n; ++i)
+				push(x[i]);
+		}
+
+		//////////////////////////////////////////////////////
+		// implementation of OOTL Iterable concept
+
+		template<typename Procedure>
+		void foreach(Procedure& proc) const
+		{
+			size_t i = 0;
+			while (i < cnt)
+			{
+				const leaf* l = get_leaf(offset + i);
+				size_t j = (offset + i) & mask;
+				while (j < width && i < cnt)
+				{
+					proc(l->items[j++]);
+					++i;
+				}
+			}
+		}
+
+		bool operator==(const self& x) const
+		{
+			if (count() != x.count())
+				return false;
+			if (root == x.root && offset == x.offset)
+				return true;
+			for (size_t i=0; i < count(); ++i)
+				if (!(operator[](i) == x[i]))
+					return false;
+			return true;
+		}
+
+	private:
+
+		//////////////////////////////////////////////////////
+		// implementation functions
+
+		const leaf* get_leaf(size_t n) const
+		{
+			const node* p = root;
+			for (int s = shift; s > 0; s -= bits)
+				p = static_cast<const branch*>(p)->kids[(n >> s) & mask];
+			return static_cast<const leaf*>(p);
+		}
+
+		static void release(node* p, int s)
+		{
+			if (p == NULL || --p->refs > 0)
+				return;
+			if (s > 0)
+			{
+				branch* b = static_cast<branch*>(p);
+				for (size_t i=0; i < width; ++i)
+					release(b->kids[i], s - bits);
+				delete b;
+			}
+			else
+			{
+				delete static_cast<leaf*>(p);
+			}
+		}
+
+		// returns a node which only this version refers to
+		static node* make_unique(node* p, int s)
+		{
+			if (p == NULL)
+			{
+				if (s > 0)
+					return new branch();
+				return new leaf();
+			}
+			if (p->refs == 1)
+				return p;
+			--p->refs;
+			if (s > 0)
+			{
+				branch* b = new branch(*static_cast<branch*>(p));
+				b->refs = 1;
+				for (size_t i=0; i < width; ++i)
+					if (b->kids[i] != NULL)
+						++b->kids[i]->refs;
+				return b;
+			}
+			leaf* l = new leaf(*static_cast<leaf*>(p));
+			l->refs = 1;
+			return l;
+		}
+
+		// returns a writable reference to the item at absolute position n,
+		// copying the nodes on its path which are shared
+		T& assoc(size_t n)
+		{
+			root = make_unique(root, shift);
+			node* p = root;
+			for (int s = shift; s > 0; s -= bits)
+			{
+				node*& kid = static_cast<branch*>(p)->kids[(n >> s) & mask];
+				kid = make_unique(kid, s - bits);
+				p = kid;
+			}
+			return static_cast<leaf*>(p)->items[n & mask];
+		}
+
+		// removes levels above the node which contains all items
+		void trim()
+		{
+			while (shift > 0 && cnt > 0 && (offset >> shift) == ((offset + cnt - 1) >> shift))
+			{
+				node* kid = static_cast<branch*>(root)->kids[(offset >> shift) & mask];
+				++kid->refs;
+				release(root, shift);
+				root = kid;
+				offset &= (width << (shift - bits)) - 1;
+				shift -= bits;
+			}
+		}
+
+		//////////////////////////////////////////////////////
+		// fields
+
+		node* root;
+		int shift;
+		size_t offset;
+		size_t cnt;
+	};
+}
+
+#endif
@@ -4,18 +4,89 @@
 // The file contains the implementation for a persistent stack: a stack class that maintains its memory layout
 // even when more memory needs to be allocated. This means that adding items always has O(1) complexity, instead
 // of O(n) in the worst case as with most common stack implementations. The implementation is based on a vlist which 
-// also provides an average case of O(1) complexity for item indexing. A vlist is a list of buffers, each twice 
-// as big as the previous. The O(1) complexity has to do with the fact that most items occur in the bigger buffers,
-// There is no "begin" and "end" like STL collections, but for iteration over the collection, you can use the "foreach" 
-// member function (or implement your own special iterator)
+// also provides O(1) complexity for item indexing. A vlist is a list of buffers, each twice 
+// as big as the previous, so the buffer holding an index is found directly from the index's highest set bit.
+// For iteration over the collection you can use the "foreach" member function, or "begin" and "end" which return 
+// random access iterators that can be used with the STL algorithms. The policy decides where the buffers come 
+// from, see ootl_vlist.hpp and ootl_arena.hpp.
 
 #ifndef OOTL_STACK_HPP
 #define OOTL_STACK_HPP
 
+#include <cstring>
+#include <type_traits>
+
 #include "ootl_vlist.hpp"
 
 namespace ootl 
 {
+	/////////////////////////////////////////////////////////
+	// functions on ranges of items, which use memcpy and memcmp 
+	// when the type allows it
+
+	// true if two items are equal exactly when their bytes are 
+	template<typename T>
+	struct is_bitwise_comparable {
+		static const bool value = std::is_integral<T>::value || std::is_pointer<T>::value || std::is_enum<T>::value;
+	};
+
+	// Copies n trivially copyable items. The path is chosen at compile time 
+	// from std::is_trivially_copyable, so memcpy is never compiled for other 
+	// types.
+	template<typename T>
+	void copy_items(T* dest, const T* src, size_t n, std::true_type) {
+		if (n > 0) memcpy(dest, src, n * sizeof(T));
+	}
+
+	// copy constructs n items into uninitialized memory
+	template<typename T>
+	void construct_items(T* dest, const T* src, size_t n, std::false_type) {
+		for (size_t i=0; i < n; ++i)
+			new(dest + i) T(src[i]);
+	}
+	template<typename T>
+	void construct_items(T* dest, const T* src, size_t n, std::true_type t) {
+		copy_items(dest, src, n, t);
+	}
+	template<typename T>
+	void construct_items(T* dest, const T* src, size_t n) {
+		construct_items(dest, src, n, typename std::is_trivially_copyable<T>::type());
+	}
+
+	// assigns n items to existing ones
+	template<typename T>
+	void assign_items(T* dest, const T* src, size_t n, std::false_type) {
+		for (size_t i=0; i < n; ++i)
+			dest[i] = src[i];
+	}
+	template<typename T>
+	void assign_items(T* dest, const T* src, size_t n, std::true_type t) {
+		copy_items(dest, src, n, t);
+	}
+	template<typename T>
+	void assign_items(T* dest, const T* src, size_t n) {
+		assign_items(dest, src, n, typename std::is_trivially_copyable<T>::type());
+	}
+
+	// destroys n items, the last one first
+	template<typename T>
+	void destroy_items(T* p, size_t n) {
+		if (!std::is_trivially_destructible<T>::value) {
+			while (n > 0) 
+				p[--n].~T();
+		}
+	}
+
+	template<typename T>
+	bool equal_items(const T* x, const T* y, size_t n) {
+		if (is_bitwise_comparable<T>::value) 
+			return n == 0 || memcmp(x, y, n * sizeof(T)) == 0;
+		for (size_t i=0; i < n; ++i)
+			if (!(x[i] == y[i]))
+				return false;
+		return true;
+	}
+
 	/////////////////////////////////////////////////////////
 	// utility functions for dealing with stack.
 
@@ -37,8 +108,8 @@ namespace ootl
 	/////////////////////////////////////////////////////////
 	// ootl::stack implementation
 
-	template < typename T >
-	struct stack : protected vlist<T>
+	template < typename T, typename Policy_T = default_vlist_policy >
+	struct stack : protected vlist<T, Policy_T>
 	{
 	public:
 		
@@ -47,6 +118,8 @@ namespace ootl
 
 		typedef stack self;
 		typedef T value_type;  
+		typedef typename vlist<T, Policy_T>::iterator iterator;
+		typedef typename vlist<T, Policy_T>::const_iterator const_iterator;
 
 		//////////////////////////////////////////////////////
 		// constructor/destructors 
@@ -56,19 +129,14 @@ namespace ootl
 		}
 		stack(const self& x) : vlist(), cnt(0), ptop(NULL) { 
 			ptop = get_first_buffer()->begin;
-			x.foreach(stacker(*this));
+			append(x);
 		}
 		stack(size_t nsize, const T& x = T()) : vlist(), cnt(0), ptop(NULL) { 
-			initialize(nsize);
 			ptop = get_first_buffer()->begin;
-			while (count() < nsize) {
-			  push(x);
-			}
+			push_n(nsize, x);
 		}
 		~stack() { 
-			while (count() > 0) {      
-			  pop();
-			}
+			pop_n(count());
 		} 
 
 		//////////////////////////////////////////////////////
@@ -154,16 +222,83 @@ namespace ootl
 			return ret;    
 		}
 		void clear() {
-			while (!is_empty()) {
-				pop();
-			}
+			pop_n(count());
 			ootl_assert(cnt == 0);
 		}
 		void clear_nodestroy() {
-			while (!is_empty()) {
-				pop_nodestroy();
+			pop_n_nodestroy(count());
+		}
+
+		///////////////////////////////////////////////////
+		// bulk operations
+		//
+		// These work a buffer at a time instead of an item at a time.
+
+		// pushes n copies of x
+		void push_n(size_t n, const T& x = T()) {
+			while (n > 0) {
+				size_t k = reserve_space(n);
+				for (size_t i=0; i < k; ++i)
+					new(ptop + i) T(x);
+				ptop += k;
+				cnt += k;
+				n -= k;
+			}
+		}
+		// pushes the items from first up to but not including last, the 
+		// last one ends up on top 
+		void append_range(const T* first, const T* last) {
+			while (first < last) {
+				size_t k = reserve_space(last - first);
+				construct_items(ptop, first, k);
+				ptop += k;
+				cnt += k;
+				first += k;
+			}
+		}
+		void append_range(T* first, T* last) {
+			append_range((const T*)first, (const T*)last);
+		}
+		template<typename Iter>
+		void append_range(Iter first, Iter last) {
+			while (first != last) 
+				push(*first++);
+		}
+		// pushes the items of another stack, keeping their order
+		void append(const self& x) {
+			size_t n = x.count();
+			for (const buffer* cur = x.get_first_buffer(); n > 0; cur = cur->next) {
+				size_t k = n < cur->size ? n : cur->size;
+				append_range(cur->begin, cur->begin + k);
+				n -= k;
+			}
+		}
+		void pop_n(size_t n) {
+			pop_items(n, true);
+		}
+		void pop_n_nodestroy(size_t n) {
+			pop_items(n, false);
+		}
+		// copies the items into an array, from the bottom of the stack to the top
+		void copy_out(T* arr) const {
+			size_t n = count();
+			for (const buffer* cur = get_first_buffer(); n > 0; cur = cur->next) {
+				size_t k = n < cur->size ? n : cur->size;
+				assign_items(arr, cur->begin, k);
+				arr += k;
+				n -= k;
 			}
 		}
+		// exchanges the contents of two stacks in constant time
+		void swap(self& x) {
+			vlist<T, Policy_T>::swap(x);
+			size_t tmp_cnt = cnt;
+			T* tmp_top = ptop;
+			cnt = x.cnt;
+			ptop = x.ptop;
+			x.cnt = tmp_cnt;
+			x.ptop = tmp_top;
+		}
 
 		//////////////////////////////////////////////////////
 		// implementation of OOTL Iterable concept 
@@ -183,75 +318,124 @@ namespace ootl
 			} 
 		}  
 
+		//////////////////////////////////////////////////////
+		// random access iterators
+		//
+		// Items are visited from the bottom of the stack to the top, which 
+		// is the same order as foreach. 
+
+		iterator begin() { 
+			return iterator(this, 0); 
+		}
+		iterator end() { 
+			return iterator(this, cnt); 
+		}
+		const_iterator begin() const { 
+			return const_iterator(this, 0); 
+		}
+		const_iterator end() const { 
+			return const_iterator(this, cnt); 
+		}
+
 		//////////////////////////////////////////////////////
 		// implementation of OOTL Growable concept
 
 		void grow(size_t n = 1, const value_type& x = value_type()) {      
-			while (n--) push(x);
+			push_n(n, x);
 		} 
 
 		//////////////////////////////////////////////////////
 		// implementation of OOTL Shrinkable concept
 
 		void shrink(size_t n = 1) {      
-			while (n--) pop();
+			pop_n(n);
 		}  
 
 		//////////////////////////////////////////////////////
 		// implementation of OOTL Resizable concept  
 
 		void resize(size_t n, const value_type& x = value_type()) {      
-			while (n > count()) push(x);
-			while (n < count()) pop();
+			if (n > count()) 
+				push_n(n - count(), x);
+			else
+				pop_n(count() - n);
 		}    
 
 		//////////////////////////////////////////////////////
 		// Utility functions
 
-		template<typename T>
 		void copy_to_array(T* arr) const
 		{
-			struct copy_proc
-			{
-				T* mp;
-				copy_proc(T* p) : mp(p) { }
-				void operator()(const T& x) { *mp++ = x; }
-			};
-
-			foreach(copy_proc(arr));
+			copy_out(arr);
 		}
 
-		// todo: this should be generalized as a zip function 
-		// or I could just use iterators
-		bool operator==(const self& x) const 
+		// Two stacks with the same policy have buffers of the same sizes, 
+		// so they are compared a buffer at a time. Calls proc(x, y, n) with 
+		// each pair of ranges of n items at the same indexes, until it 
+		// returns false. The stacks must have the same count.
+		template<typename Procedure>
+		bool compare_ranges(const self& x, Procedure& proc) const
 		{
-			if (count() != x.count()) 
-				return false;
+			ootl_assert(count() == x.count());
 			const buffer* cur1 = get_first_buffer();    
 			const buffer* cur2 = x.get_first_buffer();    
-			size_t n = 0;
-			while (n < count()) {
-				T* p1 = cur1->begin;
-				T* p2 = cur2->begin;
-				while ((p1 != cur1->end) && (p2 != cur2->end) && (n < count())) {
-					if (!(*p1 == *p2)) 
-						return false;
-					n++;
-				}
-				if (p1 == cur1->end) cur1 = cur1->next;
-				if (p2 == cur2->end) cur2 = cur2->next;
+			size_t n = count();
+			while (n > 0) {
+				ootl_assert(cur1->size == cur2->size);
+				size_t k = n < cur1->size ? n : cur1->size;
+				if (!proc(cur1->begin, cur2->begin, k)) 
+					return false;
+				n -= k;
+				cur1 = cur1->next;
+				cur2 = cur2->next;
 			} 
 			return true;
 		}
 
-		//////////////////////////////////////////////////////////////
-		// fields 
+		bool operator==(const self& x) const 
+		{
+			if (count() != x.count()) 
+				return false;
+			return compare_ranges(x, equal_items<T>);
+		}
 
 	private:
 
+		// makes sure there is room on top, and returns how many of the n 
+		// items fit in the last buffer
+		size_t reserve_space(size_t n) {
+			if (ptop == get_last_buffer()->end) {
+				add_buffer();
+				ptop = get_last_buffer()->begin;
+			}
+			size_t room = get_last_buffer()->end - ptop;
+			return n < room ? n : room;
+		}
+
+		void pop_items(size_t n, bool destroy) {
+			ootl_assert(n <= cnt);
+			while (n > 0) {
+				size_t k = ptop - get_last_buffer()->begin;
+				if (k > n) 
+					k = n;
+				if (destroy)
+					destroy_items(ptop - k, k);
+				ptop -= k;
+				cnt -= k;
+				n -= k;
+				if ((ptop == get_last_buffer()->begin) && (cnt != 0)) {
+					ptop = get_last_buffer()->prev->end;
+					remove_buffer();
+				}
+			}
+		}
+
 		// hide the assignment operator
 		void operator=(const self& x) { };
 
+		//////////////////////////////////////////////////////////////
+		// fields 
+
 		size_t cnt;
 		T* ptop;
 	};
@@ -0,0 +1,150 @@
+// Public Domain
+// http://www.ootl.org
+//
+// Counters of the work done by ootl::object and the vlist based containers,
+// which are only kept when OOTL_STATS is defined. Each thread counts into
+// its own block, so counting takes no lock or atomic operation. The blocks
+// are kept after their threads exit, so that they are part of the totals.
+// The counters of other threads may be read while they are changing, so
+// totals are approximate while other threads are running.
+//
+// Objects are counted by type: each type which is counted gets an index the
+// first time, and types past the first max_types - 1 are counted as "other".
+
+#ifndef OOTL_STATS_HPP
+#define OOTL_STATS_HPP
+
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <typeinfo>
+
+#ifdef __GNUC__
+#include <cxxabi.h>
+#endif
+
+namespace ootl
+{
+	struct stats
+	{
+		static const size_t max_types = 64;
+		static const size_t max_name = 128;
+
+		// objects constructed from a value or copied, by type index
+		size_t objects_created[max_types];
+		// by objects too big to be held inline
+		size_t payload_bytes_allocated;
+		size_t payload_bytes_freed;
+		// buffers added to and removed from the end of vlists, including spares
+		size_t buffers_added;
+		size_t buffers_removed;
+		stats* next;
+
+		// the counters of the current thread
+		static stats& local()
+		{
+			static thread_local stats* p = NULL;
+			if (p == NULL)
+				p = add_thread();
+			return *p;
+		}
+
+		// the first of the blocks of all threads, each has the next one
+		static stats* first()
+		{
+			return head();
+		}
+
+		// the number of types which have an index, and their names
+		static size_t type_count()
+		{
+			size_t n = type_counter();
+			return n < max_types ? n : max_types;
+		}
+		static const char* type_name(size_t i)
+		{
+			return type_names()[i];
+		}
+
+		// the index of a type
+		template<typename T>
+		static size_t type_index()
+		{
+			static size_t n = add_type(typeid(T));
+			return n;
+		}
+
+		// adds up the counters of all threads into x
+		static void total(stats& x)
+		{
+			memset(&x, 0, sizeof(x));
+			for (stats* p = first(); p != NULL; p = p->next)
+			{
+				for (size_t i=0; i < max_types; ++i)
+					x.objects_created[i] += p->objects_created[i];
+				x.payload_bytes_allocated += p->payload_bytes_allocated;
+				x.payload_bytes_freed += p->payload_bytes_freed;
+				x.buffers_added += p->buffers_added;
+				x.buffers_removed += p->buffers_removed;
+			}
+		}
+
+	private:
+
+		static stats*& head()
+		{
+			static stats* p = NULL;
+			return p;
+		}
+		static std::mutex& lock()
+		{
+			static std::mutex m;
+			return m;
+		}
+		static std::atomic<size_t>& type_counter()
+		{
+			static std::atomic<size_t> n(0);
+			return n;
+		}
+		static char (*type_names())[max_name]
+		{
+			static char names[max_types][max_name];
+			return names;
+		}
+
+		static stats* add_thread()
+		{
+			stats* p = (stats*)calloc(1, sizeof(stats));
+			std::lock_guard<std::mutex> guard(lock());
+			p->next = head();
+			head() = p;
+			return p;
+		}
+
+		// names are kept readable, so they can be written from a signal handler
+		static size_t add_type(const std::type_info& ti)
+		{
+			size_t n = type_counter()++;
+			if (n >= max_types - 1)
+			{
+				strcpy(type_names()[max_types - 1], "other");
+				return max_types - 1;
+			}
+			const char* s = ti.name();
+#ifdef __GNUC__
+			int status = 0;
+			char* demangled = abi::__cxa_demangle(s, NULL, NULL, &status);
+			if (demangled != NULL)
+				s = demangled;
+#endif
+			strncpy(type_names()[n], s, max_name - 1);
+#ifdef __GNUC__
+			free(demangled);
+#endif
+			return n;
+		}
+	};
+}
+
+#endif
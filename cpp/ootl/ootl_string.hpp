@@ -15,7 +15,7 @@ namespace ootl
 		cstring(const char* x) : m(x) { }
 		cstring(const cstring& x) : m(x.m) { }
 		operator const char*() { return to_ptr(); }
-		const char* to_ptr() { return m; }
+		const char* to_ptr() const { return m; }
 		bool operator==(const cstring& x) const 
 		{
 			const char* left = m;
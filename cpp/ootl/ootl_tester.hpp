@@ -7,8 +7,12 @@
 
 #include <iostream>
 
+// the number of checks which failed
+int ootl_test_failures = 0;
+
 void TestFailed(const char* text) {
   std::cerr << "failed : " << text << std::endl;
+  ++ootl_test_failures;
 }
 
 void TestPassed(const char* text) {
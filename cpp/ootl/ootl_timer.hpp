@@ -6,6 +6,18 @@
 
 // for clock() and CLOCKS_PER_SEC
 #include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <chrono>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace ootl
 {  
@@ -79,6 +91,369 @@ namespace ootl
 		}
 	};
 
+	//////////////////////////////////////////////////////////////////////////
+	// hardware counters
+	//
+	// Counts the events of the calling thread in user mode, through
+	// perf_event_open on Linux. A counter which can't be opened (there is no
+	// PMU, as in many virtual machines, or perf_event_paranoid forbids it) is
+	// left unavailable, and elsewhere none are. Setting OOTL_PERF=0 in the
+	// environment leaves them all unavailable.
+	//
+	// Cycles lead a group with the other events, so that when the PMU 
+	// multiplexes them they are all counted over the same intervals, and 
+	// instructions per cycle divides counts which were measured together. 
+	// An event which can't join the group, or all of them if the group can't
+	// be scheduled, is counted on its own.
+
+	enum perf_counter_id
+	{
+		perf_cycles, perf_instructions, perf_branch_misses, perf_l1d_misses,
+		perf_llc_misses, perf_counter_count
+	};
+
+	struct perf_counters
+	{
+		perf_counters()
+			: leader(-1), group_size(0), error(0)
+		{
+			for (int i=0; i < perf_counter_count; ++i)
+			{
+				fds[i] = -1;
+				values[i] = -1.0;
+				in_group[i] = false;
+			}
+			const char* env = getenv("OOTL_PERF");
+			if (env != NULL && strcmp(env, "0") == 0)
+				return;
+#ifdef __linux__
+			open_group();
+			if (leader >= 0 && !group_scheduled())
+				close_group();
+			for (int i=0; i < perf_counter_count; ++i)
+			{
+				if (fds[i] >= 0)
+					continue;
+				fds[i] = open_event(i, -1, false);
+				if (fds[i] < 0 && error == 0)
+					error = errno;
+			}
+#endif
+		}
+
+		~perf_counters()
+		{
+#ifdef __linux__
+			for (int i=0; i < perf_counter_count; ++i)
+				if (fds[i] >= 0)
+					close(fds[i]);
+#endif
+		}
+
+		bool available(int i) const
+		{
+			return fds[i] >= 0;
+		}
+
+		bool any_available() const
+		{
+			for (int i=0; i < perf_counter_count; ++i)
+				if (available(i))
+					return true;
+			return false;
+		}
+
+		// why the first counter which couldn't be opened wasn't, or NULL
+		const char* why_unavailable() const
+		{
+			const char* env = getenv("OOTL_PERF");
+			if (env != NULL && strcmp(env, "0") == 0)
+				return "OOTL_PERF=0";
+#ifdef __linux__
+			return error == 0 ? NULL : strerror(error);
+#else
+			return "perf_event_open is only on Linux";
+#endif
+		}
+
+		void start()
+		{
+#ifdef __linux__
+			if (leader >= 0)
+				ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			for (int i=0; i < perf_counter_count; ++i)
+				if (fds[i] >= 0 && !in_group[i])
+					ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+			if (leader >= 0)
+				ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+			for (int i=0; i < perf_counter_count; ++i)
+				if (fds[i] >= 0 && !in_group[i])
+					ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+		}
+
+		void stop()
+		{
+#ifdef __linux__
+			if (leader >= 0)
+				ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			for (int i=0; i < perf_counter_count; ++i)
+				if (fds[i] >= 0 && !in_group[i])
+					ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+			for (int i=0; i < perf_counter_count; ++i)
+				values[i] = -1.0;
+			read_group();
+			for (int i=0; i < perf_counter_count; ++i)
+			{
+				unsigned long long x[3];
+				if (fds[i] < 0 || in_group[i] || read(fds[i], x, sizeof(x)) != sizeof(x) || x[2] == 0)
+					continue;
+				values[i] = (double)x[0] * ((double)x[1] / (double)x[2]);
+			}
+#endif
+		}
+
+		// the count between start and stop, negative if it is unavailable
+		double value(int i) const
+		{
+			return values[i];
+		}
+
+		static const char* name(int i)
+		{
+			static const char* names[perf_counter_count] = {
+				"cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"
+			};
+			return names[i];
+		}
+
+	private:
+
+		perf_counters(const perf_counters&);
+		void operator=(const perf_counters&);
+
+#ifdef __linux__
+		// opens an event disabled, or in the group led by group_fd, which 
+		// enables it with its leader
+		static int open_event(int i, int group_fd, bool grouped)
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			event_of(i, attr.type, attr.config);
+			attr.disabled = group_fd < 0 ? 1 : 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			// the counters may be multiplexed, the values are scaled up
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			if (grouped)
+				attr.read_format |= PERF_FORMAT_GROUP;
+			return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+		}
+
+		// events which can't join the group are left closed
+		void open_group()
+		{
+			leader = open_event(perf_cycles, -1, true);
+			if (leader < 0)
+				return;
+			fds[perf_cycles] = leader;
+			in_group[perf_cycles] = true;
+			order[group_size++] = perf_cycles;
+			for (int i=0; i < perf_counter_count; ++i)
+			{
+				if (i == perf_cycles)
+					continue;
+				fds[i] = open_event(i, leader, true);
+				if (fds[i] < 0)
+					continue;
+				in_group[i] = true;
+				order[group_size++] = i;
+			}
+		}
+
+		void close_group()
+		{
+			for (int i=0; i < perf_counter_count; ++i)
+			{
+				if (!in_group[i])
+					continue;
+				close(fds[i]);
+				fds[i] = -1;
+				in_group[i] = false;
+			}
+			leader = -1;
+			group_size = 0;
+		}
+
+		// Counts a little work with the group. A group which is never 
+		// scheduled, because the PMU can't count all of it at once, has no 
+		// running time.
+		bool group_scheduled()
+		{
+			start();
+			volatile unsigned int x = 0;
+			for (unsigned int i=0; i < 100000; ++i)
+				x = x + i;
+			stop();
+			return values[perf_cycles] >= 0.0;
+		}
+
+		// The values are in the order the events were added. They all have 
+		// the same times, so they are scaled up by the same ratio.
+		void read_group()
+		{
+			if (leader < 0)
+				return;
+			unsigned long long x[3 + perf_counter_count];
+			ssize_t n = read(leader, x, sizeof(x));
+			if (n < (ssize_t)(3 * sizeof(x[0])) || x[2] == 0)
+				return;
+			double scale = (double)x[1] / (double)x[2];
+			for (size_t k=0; k < x[0] && k < (size_t)group_size; ++k)
+				values[order[k]] = (double)x[3 + k] * scale;
+		}
+
+		static void event_of(int i, unsigned int& type, unsigned long long& config)
+		{
+			const unsigned long long read_miss =
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			switch (i)
+			{
+			case perf_cycles:
+				type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CPU_CYCLES; break;
+			case perf_instructions:
+				type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_INSTRUCTIONS; break;
+			case perf_branch_misses:
+				type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_BRANCH_MISSES; break;
+			case perf_l1d_misses:
+				type = PERF_TYPE_HW_CACHE; config = PERF_COUNT_HW_CACHE_L1D | read_miss; break;
+			default:
+				type = PERF_TYPE_HW_CACHE; config = PERF_COUNT_HW_CACHE_LL | read_miss; break;
+			}
+		}
+#endif
+
+		int fds[perf_counter_count];
+		double values[perf_counter_count];
+		// the events of the group led by cycles, in the order they were added
+		bool in_group[perf_counter_count];
+		int order[perf_counter_count];
+		int leader;
+		int group_size;
+		int error;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// benchmark harness
+	//
+	// Runs a function a number of times, and keeps the fastest run by the
+	// wall clock with the counters of that run. Each run does ops operations,
+	// whatever the benchmark counts as one, which the counts are divided by.
+
+	struct bench_result
+	{
+		const char* name;
+		size_t ops;
+		double seconds;
+		double counts[perf_counter_count];
+
+		bool has(int i) const
+		{
+			return counts[i] >= 0.0;
+		}
+
+		// instructions per cycle, negative if either is unavailable
+		double ipc() const
+		{
+			if (!has(perf_cycles) || !has(perf_instructions) || counts[perf_cycles] == 0.0)
+				return -1.0;
+			return counts[perf_instructions] / counts[perf_cycles];
+		}
+
+		double ns_per_op() const
+		{
+			return ops == 0 ? 0.0 : seconds * 1e9 / ops;
+		}
+
+		// negative if it is unavailable
+		double per_op(int i) const
+		{
+			if (!has(i) || ops == 0)
+				return -1.0;
+			return counts[i] / ops;
+		}
+	};
+
+	struct bench_harness
+	{
+		bench_harness(FILE* f = stdout)
+			: mf(f), header(false)
+		{
+		}
+
+		template<typename Fxn_T>
+		bench_result run(const char* name, Fxn_T f, size_t ops, int reps = 3)
+		{
+			bench_result r;
+			r.name = name;
+			r.ops = ops;
+			r.seconds = -1.0;
+			for (int i=0; i < perf_counter_count; ++i)
+				r.counts[i] = -1.0;
+			for (int rep=0; rep < reps; ++rep)
+			{
+				counters.start();
+				std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+				f();
+				std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+				counters.stop();
+				double d = std::chrono::duration<double>(t1 - t0).count();
+				if (r.seconds < 0.0 || d < r.seconds)
+				{
+					r.seconds = d;
+					for (int i=0; i < perf_counter_count; ++i)
+						r.counts[i] = counters.value(i);
+				}
+			}
+			print(r);
+			return r;
+		}
+
+		void print(const bench_result& r)
+		{
+			if (!header)
+			{
+				header = true;
+				if (!counters.any_available())
+					fprintf(mf, "hardware counters unavailable: %s\n", counters.why_unavailable());
+				fprintf(mf, "%-28s %10s %10s %6s %10s %10s %10s %10s\n", "benchmark", "sec",
+					"ns/op", "IPC", "cycles/op", "br-mis/op", "L1d-mis/op", "LLC-mis/op");
+			}
+			fprintf(mf, "%-28s %10.4f %10.2f", r.name, r.seconds, r.ns_per_op());
+			column(r.ipc(), 6, 2);
+			column(r.per_op(perf_cycles), 10, 1);
+			column(r.per_op(perf_branch_misses), 10, 3);
+			column(r.per_op(perf_l1d_misses), 10, 3);
+			column(r.per_op(perf_llc_misses), 10, 3);
+			fprintf(mf, "\n");
+		}
+
+	private:
+
+		void column(double x, int width, int precision)
+		{
+			if (x < 0.0)
+				fprintf(mf, " %*s", width, "-");
+			else
+				fprintf(mf, " %*.*f", width, precision, x);
+		}
+
+		FILE* mf;
+		bool header;
+		perf_counters counters;
+	};
+
 } 
 
 #endif
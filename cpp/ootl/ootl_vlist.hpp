@@ -5,7 +5,21 @@
 #define OOTL_VLIST_HPP
 
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
 #include <memory>
+#include <new>
+#include <iterator>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "ootl_stats.hpp"
 
 #ifdef DEBUG
 void ootl_assert(bool b) {
@@ -19,10 +33,206 @@ void ootl_assert(bool b) {
 
 namespace ootl 
 {
+	// index of the most significant set bit, x must not be zero
+	inline size_t msb(size_t x)
+	{
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long i;
+		_BitScanReverse64(&i, x);
+		return i;
+#elif defined(_MSC_VER)
+		unsigned long i;
+		_BitScanReverse(&i, x);
+		return i;
+#elif defined(__GNUC__)
+		return 63 - __builtin_clzll(static_cast<unsigned long long>(x));
+#else
+		size_t i = 0;
+		while (x >>= 1) 
+			++i;
+		return i;
+#endif
+	}
+
+	// Thread-local free lists of buffer memory, one for each power of two 
+	// size up to max_block_size, shared by all vlists. Freed buffers are 
+	// kept here for reuse instead of being returned to the heap. 
+	struct buffer_pool
+	{
+		static const size_t max_block_size = 1 << 20;
+		static const size_t max_blocks = 8;
+		static const size_t num_classes = 21;
+
+		static void* allocate(size_t bytes) 
+		{
+			if (bytes > max_block_size)
+				return malloc(bytes);
+			size_t k = size_class(bytes);
+			state& s = get_state();
+			if (s.counts[k] > 0)
+				return s.blocks[k][--s.counts[k]];
+			return malloc((size_t)1 << k);
+		}
+		static void deallocate(void* p, size_t bytes) 
+		{
+			if (bytes <= max_block_size)
+			{
+				size_t k = size_class(bytes);
+				state& s = get_state();
+				if (!s.closed && s.counts[k] < max_blocks)
+				{
+					s.blocks[k][s.counts[k]++] = p;
+					return;
+				}
+			}
+			free(p);
+		}
+
+	private:
+
+		// plain data, so it is usable even after the thread's cleanup ran
+		struct state
+		{
+			void* blocks[num_classes][max_blocks];
+			size_t counts[num_classes];
+			bool closed;
+		};
+
+		// releases the pooled memory when the thread exits
+		struct cleanup
+		{
+			cleanup(state& x) : s(x) { }
+			~cleanup() 
+			{
+				for (size_t k=0; k < num_classes; ++k)
+					while (s.counts[k] > 0)
+						free(s.blocks[k][--s.counts[k]]);
+				s.closed = true;
+			}
+			state& s;
+		};
+
+		static size_t size_class(size_t bytes)
+		{
+			return bytes <= 1 ? 0 : msb(bytes - 1) + 1;
+		}
+
+		static state& get_state()
+		{
+			static thread_local state s;
+			static thread_local cleanup c(s);
+			return c.s;
+		}
+	};
+
+	// The policy of a vlist decides the size of its buffers and where their 
+	// memory comes from. 
 	struct default_vlist_policy
 	{
 		static size_t initial_size() { return 8; }
 		static size_t new_size(size_t old_size) { return old_size * 2; }
+		// how many removed buffers a vlist keeps for regrowing, the oldest 
+		// (and largest) is released when the vlist shrinks past more buffers
+		static size_t spare_buffers() { return 1; }
+		// true if initial_size() is a power of two and new_size() doubles, 
+		// which lets an index be mapped directly to its buffer
+		static const bool doubling = true;
+		// true if new buffers must be zero filled, types which construct 
+		// their items before reading them don't need it
+		static const bool zero_fill = true;
+
+		static void* allocate(size_t bytes, bool zero) 
+		{
+			void* p = buffer_pool::allocate(bytes);
+			if (zero)
+				memset(p, 0, bytes);
+			return p;
+		}
+		static void deallocate(void* p, size_t bytes) 
+		{
+			buffer_pool::deallocate(p, bytes);
+		}
+	};
+
+	// Maps big buffers directly from the operating system, and asks for them 
+	// to be backed by huge pages, which saves the page faults and TLB misses 
+	// of 4K pages on stacks of many megabytes. Mapped pages are already zero.
+	// On Windows every buffer comes from the pool.
+	struct mapped_vlist_policy : default_vlist_policy
+	{
+		// the size of a huge page on x86
+		static size_t map_threshold() { return 1 << 21; }
+
+		static void* allocate(size_t bytes, bool zero) 
+		{
+#ifndef _WIN32
+			if (bytes >= map_threshold())
+			{
+				void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (p == MAP_FAILED)
+					throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+				madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+				return p;
+			}
+#endif
+			return default_vlist_policy::allocate(bytes, zero);
+		}
+		static void deallocate(void* p, size_t bytes) 
+		{
+#ifndef _WIN32
+			if (bytes >= map_threshold())
+			{
+				munmap(p, bytes);
+				return;
+			}
+#endif
+			default_vlist_policy::deallocate(p, bytes);
+		}
+	};
+
+	// random access iterator over the items of a vlist, in index order
+	template<typename Value_T, typename Vlist_T>
+	struct vlist_iterator
+	{
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef Value_T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef Value_T* pointer;
+		typedef Value_T& reference;
+		typedef vlist_iterator self;
+
+		vlist_iterator() : v(NULL), n(0) { }
+		vlist_iterator(Vlist_T* x, size_t i) : v(x), n(i) { }
+		// allows conversion from an iterator to a const iterator
+		template<typename V, typename L>
+		vlist_iterator(const vlist_iterator<V, L>& x) : v(x.v), n(x.n) { }
+
+		reference operator*() const { return *v->get_pointer(n); }
+		pointer operator->() const { return v->get_pointer(n); }
+		reference operator[](difference_type i) const { return *v->get_pointer(n + i); }
+
+		self& operator++() { ++n; return *this; }
+		self& operator--() { --n; return *this; }
+		self operator++(int) { self tmp = *this; ++n; return tmp; }
+		self operator--(int) { self tmp = *this; --n; return tmp; }
+		self& operator+=(difference_type i) { n += i; return *this; }
+		self& operator-=(difference_type i) { n -= i; return *this; }
+		self operator+(difference_type i) const { return self(v, n + i); }
+		self operator-(difference_type i) const { return self(v, n - i); }
+		friend self operator+(difference_type i, const self& x) { return x + i; }
+		difference_type operator-(const self& x) const { return difference_type(n) - difference_type(x.n); }
+
+		bool operator==(const self& x) const { return n == x.n; }
+		bool operator!=(const self& x) const { return n != x.n; }
+		bool operator<(const self& x) const { return n < x.n; }
+		bool operator>(const self& x) const { return n > x.n; }
+		bool operator<=(const self& x) const { return n <= x.n; }
+		bool operator>=(const self& x) const { return n >= x.n; }
+
+		Vlist_T* v;
+		size_t n;
 	};
 
 	template<typename T, typename Policy_T = default_vlist_policy>
@@ -31,13 +241,29 @@ namespace ootl
 		vlist() 
 		{ 
 			mCap = Policy_T::initial_size();
-			mFirst = new buffer(mCap);
+			mFirst = create_buffer(mCap, 0);
 			mLast = mFirst;
+			mDir = NULL;
+			mDirCap = 0;
+			mNumBuffers = 1;
+			mInitShift = msb(mCap);
+			mDirect = Policy_T::doubling && (mCap == ((size_t)1 << mInitShift));
+			mSpares = NULL;
+			mNumSpares = 0;
 		}
 		~vlist()
 		{
 			while (mLast != NULL)
 				remove_buffer();
+			while (mSpares != NULL)
+			{
+				buffer* tmp = mSpares;
+				mSpares = tmp->next;
+				destroy_buffer(tmp);
+			}
+			destroy_buffer(mFirst);
+			if (mDir != NULL)
+				Policy_T::deallocate(mDir, mDirCap * sizeof(buffer*));
 		}
 
 		//////////////////////////////////////////////////////
@@ -45,6 +271,11 @@ namespace ootl
 
 		typedef vlist self;
 		typedef T value_type;
+		typedef vlist_iterator<T, self> iterator;
+		typedef vlist_iterator<const T, const self> const_iterator;
+
+		// enough buffers for any index, since each one doubles in size
+		static const size_t max_buffers = sizeof(size_t) * 8;
 
 		//////////////////////////////////////////////////////
 		// buffer data structure
@@ -52,20 +283,19 @@ namespace ootl
 		struct buffer  
 		{
 			buffer(size_t n, size_t i = 0) : 
-				size(n),
 				index(i), 
+				size(n),
+				begin((T*)Policy_T::allocate(n * sizeof(T), Policy_T::zero_fill)),
+				end(begin + n),
 				prev(NULL), 
-				next(NULL),
-				begin((T*)malloc(n * sizeof(T))),
-				end(begin + n)
+				next(NULL)
 			{ 
 				ootl_assert(n >= Policy_T::initial_size());				
-				memset(begin, 0, n * sizeof(T));
 			}
 
 			~buffer()
 			{
-				free(begin);
+				Policy_T::deallocate(begin, size * sizeof(T));
 			}
 
 			size_t index; 
@@ -99,10 +329,17 @@ namespace ootl
 		{
 			ootl_assert(n >= 0);
 			ootl_assert(n < mCap);
+			// the last buffer holds about half of the items
 			if (n >= mLast->index) 
 			{ 
 				return mLast->begin + (n - mLast->index); 
 			}
+			if (mDirect)
+			{
+				// buffer k starts at initial_size * (2^k - 1)
+				buffer* b = mDir[msb(n + ((size_t)1 << mInitShift)) - mInitShift];
+				return b->begin + (n - b->index);
+			}
 			buffer* curr = mLast->prev;    
 			ootl_assert(curr != NULL);
 			while (n < curr->index) 
@@ -125,24 +362,43 @@ namespace ootl
 			if (mLast == NULL) 
 			{
 				mLast = mFirst;
+				mNumBuffers = 1;
+			}
+			else if (mSpares != NULL)
+			{
+				// A spare is the buffer that followed the last one. It is not 
+				// zeroed again, only new buffers are zero filled.
+				buffer* x = mSpares;
+				mSpares = x->next;
+				x->next = NULL;
+				--mNumSpares;
+				add_buffer(x);
 			}
 			else 
 			{
-				add_buffer(new buffer(Policy_T::new_size(mLast->size), mCap));
+				add_buffer(create_buffer(Policy_T::new_size(mLast->size), mCap));
 			}
 		}
 		void add_buffer(buffer* x) 
 		{
 			ootl_assert(mLast != NULL);
 			ootl_assert(x != NULL);
+			ootl_assert(mNumBuffers < max_buffers);
 			x->prev = mLast;
 			mLast->next = x;
 			mLast = x;
 			mCap += mLast->size;
+			if (mNumBuffers >= mDirCap)
+				grow_directory();
+			mDir[mNumBuffers++] = x;
+#ifdef OOTL_STATS
+			++stats::local().buffers_added;
+#endif
 		}    
 		void remove_buffer() 
 		{
 			ootl_assert(mLast != NULL);
+			--mNumBuffers;
 			if (mLast == mFirst)
 			{
 				mLast = NULL;
@@ -154,12 +410,100 @@ namespace ootl
 				mLast = mLast->prev;
 				ootl_assert(mLast != NULL);
 				mLast->next = NULL;
-				delete(tmp);
+				tmp->prev = NULL;
+				retain_buffer(tmp);
+#ifdef OOTL_STATS
+				++stats::local().buffers_removed;
+#endif
 			}
 		}    
+		// exchanges the buffers of two vlists in constant time
+		void swap(self& x)
+		{
+			buffer* first = mFirst;
+			buffer* last = mLast;
+			size_t cap = mCap;
+			mFirst = x.mFirst;
+			mLast = x.mLast;
+			mCap = x.mCap;
+			x.mFirst = first;
+			x.mLast = last;
+			x.mCap = cap;
+			buffer** dir = mDir;
+			mDir = x.mDir;
+			x.mDir = dir;
+			size_t num = mDirCap;
+			mDirCap = x.mDirCap;
+			x.mDirCap = num;
+			num = mNumBuffers;
+			mNumBuffers = x.mNumBuffers;
+			x.mNumBuffers = num;
+			buffer* spares = mSpares;
+			mSpares = x.mSpares;
+			x.mSpares = spares;
+			num = mNumSpares;
+			mNumSpares = x.mNumSpares;
+			x.mNumSpares = num;
+		}
 
 	private:
 
+		// Keeps a removed buffer so that growing again doesn't allocate. 
+		// Spares are linked through their next fields, the most recently 
+		// removed (and smallest) first, so the oldest is at the end.
+		void retain_buffer(buffer* x)
+		{
+			if (mNumSpares == Policy_T::spare_buffers())
+			{
+				if (mNumSpares == 0)
+				{
+					destroy_buffer(x);
+					return;
+				}
+				buffer** oldest = &mSpares;
+				while ((*oldest)->next != NULL)
+					oldest = &(*oldest)->next;
+				destroy_buffer(*oldest);
+				*oldest = NULL;
+				--mNumSpares;
+			}
+			x->next = mSpares;
+			mSpares = x;
+			++mNumSpares;
+		}
+
+		// The directory is only needed once there is a second buffer, and 
+		// doubles as buffers are added.
+		void grow_directory()
+		{
+			size_t n = mDirCap == 0 ? 8 : mDirCap * 2;
+			if (n > max_buffers)
+				n = max_buffers;
+			buffer** dir = (buffer**)Policy_T::allocate(n * sizeof(buffer*), false);
+			if (mDir == NULL)
+			{
+				dir[0] = mFirst;
+			}
+			else
+			{
+				memcpy(dir, mDir, mNumBuffers * sizeof(buffer*));
+				Policy_T::deallocate(mDir, mDirCap * sizeof(buffer*));
+			}
+			mDir = dir;
+			mDirCap = n;
+		}
+
+		// buffers are allocated through the policy, like their items
+		static buffer* create_buffer(size_t n, size_t i)
+		{
+			return new(Policy_T::allocate(sizeof(buffer), false)) buffer(n, i);
+		}
+		static void destroy_buffer(buffer* x)
+		{
+			x->~buffer();
+			Policy_T::deallocate(x, sizeof(buffer));
+		}
+
 		// hide the copy constructor 
 		vlist(const self& x) { };
 
@@ -172,6 +516,16 @@ namespace ootl
 		buffer* mFirst; 
 		buffer* mLast;
 		size_t mCap;
+		// the buffers in order, for finding the buffer of an index directly,
+		// NULL until there is a second buffer
+		buffer** mDir;
+		size_t mDirCap;
+		size_t mNumBuffers;
+		size_t mInitShift;
+		bool mDirect;
+		// removed buffers kept for regrowing, at most spare_buffers()
+		buffer* mSpares;
+		size_t mNumSpares;
 	};
 }
 
@@ -0,0 +1,495 @@
+// Public Domain
+// by Christopher Diggins 
+// http://www.ootl.org
+//
+// Micro-benchmarks for the OOTL containers
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <string>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <any>
+#define OOTL_BENCH_ANY
+#endif
+
+#include "..\ootl\ootl_stack.hpp"
+#include "..\ootl\ootl_arena.hpp"
+#include "..\ootl\ootl_hash.hpp"
+#include "..\ootl\ootl_string.hpp"
+#include "..\ootl\ootl_object.hpp"
+#include "..\ootl\ootl_timer.hpp"
+
+using namespace ootl;
+
+// a policy which frees buffers as soon as they are removed
+struct no_spare_vlist_policy : default_vlist_policy
+{
+	static size_t spare_buffers() { return 0; }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// boundary oscillation 
+//
+// A stack that grows and shrinks across the start of a buffer adds and 
+// removes that buffer every time. 
+
+template<typename Policy_T>
+double oscillate_buffers(size_t nbuffers, int n)
+{
+	vlist<int, Policy_T> v;
+	for (size_t i=1; i < nbuffers; ++i)
+		v.add_buffer();
+	second_timer t;
+	for (int i=0; i < n; ++i)
+	{
+		v.add_buffer();
+		v.remove_buffer();
+	}
+	return t.last_elapsed();
+}
+
+double oscillate_stack(size_t depth, int n)
+{
+	stack<int> s;
+	while (s.count() < depth)
+		s.push(0);
+	second_timer t;
+	for (int i=0; i < n; ++i)
+	{
+		s.push(i);
+		s.pop();
+	}
+	return t.last_elapsed();
+}
+
+void bench_boundary_oscillation()
+{
+	const int n = 100000;
+	printf("boundary oscillation, %d times\n", n);
+	printf("%10s %10s %12s %12s %12s\n", "depth", "buffer", "no spare", "spare", "stack");
+	// each depth fills its last buffer exactly, so every push adds a buffer
+	size_t size = 8;
+	size_t depth = 8;
+	for (size_t nbuffers = 1; nbuffers <= 12; ++nbuffers)
+	{
+		double no_spare = oscillate_buffers<no_spare_vlist_policy>(nbuffers, n);
+		double spare = oscillate_buffers<default_vlist_policy>(nbuffers, n);
+		double stk = oscillate_stack(depth, n);
+		size *= 2;
+		printf("%10u %10u %12f %12f %12f\n", (unsigned)depth, (unsigned)size, no_spare, spare, stk);
+		depth += size;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// filling a big stack
+//
+// Compares where the buffers come from, and the cost of zero filling them.
+
+struct unzeroed_vlist_policy : default_vlist_policy
+{
+	static const bool zero_fill = false;
+};
+
+struct unzeroed_mapped_vlist_policy : mapped_vlist_policy
+{
+	static const bool zero_fill = false;
+};
+
+template<typename Policy_T>
+double fill_stack(size_t n)
+{
+	second_timer t;
+	{
+		stack<int, Policy_T> s;
+		for (size_t i=0; i < n; ++i)
+			s.push((int)i);
+	}
+	return t.last_elapsed();
+}
+
+void bench_fill()
+{
+	const size_t n = 1 << 26;
+	printf("filling a stack with %u ints\n", (unsigned)n);
+	printf("%20s %f\n", "default", fill_stack<default_vlist_policy>(n));
+	printf("%20s %f\n", "unzeroed", fill_stack<unzeroed_vlist_policy>(n));
+	printf("%20s %f\n", "mapped", fill_stack<mapped_vlist_policy>(n));
+	printf("%20s %f\n", "unzeroed mapped", fill_stack<unzeroed_mapped_vlist_policy>(n));
+	printf("%20s %f\n", "arena", fill_stack<arena_vlist_policy>(n));
+	arena::current().reset();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ootl against the standard library
+//
+// Each benchmark does about bench_work operations whatever the size, by
+// repeating itself on the smaller sizes, and is timed by bench_harness (see
+// ootl_timer.hpp). An operation is an element pushed, popped, read or
+// copied, a lookup, or an object copied. ootl::stack stands for vlist, which
+// it is built on.
+
+const size_t bench_work = 1 << 22;
+
+// the results are added in, so the work isn't optimized away
+volatile size_t bench_sink = 0;
+
+size_t bench_reps(size_t n)
+{
+	return n >= bench_work ? 1 : bench_work / n;
+}
+
+// a fixed sequence, so every container sees the same one
+size_t bench_random()
+{
+	static unsigned long long x = 88172645463325252ULL;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return (size_t)x;
+}
+
+// the same operations on each container
+template<typename T, typename P> void bench_push(stack<T, P>& c, const T& x) { c.push(x); }
+template<typename T> void bench_push(std::vector<T>& c, const T& x) { c.push_back(x); }
+template<typename T> void bench_push(std::deque<T>& c, const T& x) { c.push_back(x); }
+void bench_push(ootl::string& c, char x) { c.push(x); }
+void bench_push(std::string& c, char x) { c.push_back(x); }
+
+template<typename T, typename P> void bench_pop(stack<T, P>& c) { c.pop(); }
+template<typename T> void bench_pop(std::vector<T>& c) { c.pop_back(); }
+template<typename T> void bench_pop(std::deque<T>& c) { c.pop_back(); }
+
+template<typename T, typename P> size_t bench_count(const stack<T, P>& c) { return c.count(); }
+template<typename T> size_t bench_count(const std::vector<T>& c) { return c.size(); }
+template<typename T> size_t bench_count(const std::deque<T>& c) { return c.size(); }
+size_t bench_count(const ootl::string& c) { return c.count(); }
+size_t bench_count(const std::string& c) { return c.size(); }
+
+// a reference, so it works whether foreach takes the procedure by value
+struct sum_proc
+{
+	sum_proc(size_t& x) : n(x) { }
+	void operator()(int x) { n += x; }
+	size_t& n;
+};
+
+template<typename T, typename P> size_t bench_sum(const stack<T, P>& c)
+{
+	size_t n = 0;
+	sum_proc proc(n);
+	c.foreach(proc);
+	return n;
+}
+
+template<typename C> size_t bench_sum(const C& c)
+{
+	size_t n = 0;
+	for (typename C::const_iterator i = c.begin(); i != c.end(); ++i)
+		n += *i;
+	return n;
+}
+
+template<typename C> size_t bench_sum_iterators(C& c)
+{
+	size_t n = 0;
+	for (typename C::iterator i = c.begin(); i != c.end(); ++i)
+		n += *i;
+	return n;
+}
+
+template<typename C>
+void bench_fill_with(C& c, size_t n)
+{
+	for (size_t i=0; i < n; ++i)
+		bench_push(c, (int)i);
+}
+
+template<typename C>
+struct push_pop_bench
+{
+	push_pop_bench(size_t n) : n(n) { }
+	void operator()()
+	{
+		for (size_t r = bench_reps(n); r > 0; --r)
+		{
+			C c;
+			bench_fill_with(c, n);
+			for (size_t i=0; i < n; ++i)
+				bench_pop(c);
+			bench_sink += bench_count(c);
+		}
+	}
+	size_t n;
+};
+
+template<typename C>
+struct random_access_bench
+{
+	random_access_bench(const C& c, const std::vector<size_t>& indexes) : c(c), indexes(indexes) { }
+	void operator()()
+	{
+		size_t n = 0;
+		for (size_t r = bench_reps(indexes.size()); r > 0; --r)
+			for (size_t i=0; i < indexes.size(); ++i)
+				n += c[indexes[i]];
+		bench_sink += n;
+	}
+	const C& c;
+	const std::vector<size_t>& indexes;
+};
+
+template<typename C>
+struct iterate_bench
+{
+	iterate_bench(const C& c) : c(c) { }
+	void operator()()
+	{
+		for (size_t r = bench_reps(bench_count(c)); r > 0; --r)
+			bench_sink += bench_sum(c);
+	}
+	const C& c;
+};
+
+template<typename C>
+struct iterator_bench
+{
+	iterator_bench(C& c) : c(c) { }
+	void operator()()
+	{
+		for (size_t r = bench_reps(bench_count(c)); r > 0; --r)
+			bench_sink += bench_sum_iterators(c);
+	}
+	C& c;
+};
+
+template<typename C>
+struct copy_bench
+{
+	copy_bench(const C& c) : c(c) { }
+	void operator()()
+	{
+		for (size_t r = bench_reps(bench_count(c)); r > 0; --r)
+		{
+			C copy(c);
+			bench_sink += bench_count(copy);
+		}
+	}
+	const C& c;
+};
+
+template<typename C>
+struct string_append_bench
+{
+	string_append_bench(size_t n) : n(n) { }
+	void operator()()
+	{
+		for (size_t r = bench_reps(n); r > 0; --r)
+		{
+			C s("");
+			for (size_t i=0; i < n; ++i)
+				bench_push(s, (char)('a' + i % 26));
+			bench_sink += bench_count(s);
+		}
+	}
+	size_t n;
+};
+
+int* bench_find(hash_map<int, int>& m, int key)
+{
+	return m.find(key);
+}
+
+int* bench_find(std::unordered_map<int, int>& m, int key)
+{
+	std::unordered_map<int, int>::iterator i = m.find(key);
+	return i == m.end() ? NULL : &i->second;
+}
+
+template<typename M>
+struct lookup_bench
+{
+	lookup_bench(M& m, const std::vector<int>& keys) : m(m), keys(keys) { }
+	void operator()()
+	{
+		size_t found = 0;
+		for (size_t r = bench_reps(keys.size()); r > 0; --r)
+			for (size_t i=0; i < keys.size(); ++i)
+				if (bench_find(m, keys[i]) != NULL)
+					++found;
+		bench_sink += found;
+	}
+	M& m;
+	const std::vector<int>& keys;
+};
+
+void bench_insert(hash_map<int, int>& m, int key, int value)
+{
+	m.add(key, value);
+}
+
+void bench_insert(std::unordered_map<int, int>& m, int key, int value)
+{
+	m[key] = value;
+}
+
+template<typename M>
+void bench_lookups(bench_harness& h, const char* name, size_t n)
+{
+	// the keys are 1 to n, as ootl::hash_map keeps 0 for unused slots
+	M m;
+	for (size_t i=1; i <= n; ++i)
+		bench_insert(m, (int)i, (int)i);
+	std::vector<int> hits;
+	std::vector<int> misses;
+	for (size_t i=0; i < n; ++i)
+	{
+		hits.push_back((int)(1 + bench_random() % n));
+		misses.push_back((int)(n + 1 + bench_random() % n));
+	}
+	char buf[64];
+	sprintf(buf, "lookup hit %s", name);
+	h.run(buf, lookup_bench<M>(m, hits), bench_reps(n) * n);
+	sprintf(buf, "lookup miss %s", name);
+	h.run(buf, lookup_bench<M>(m, misses), bench_reps(n) * n);
+}
+
+template<typename C>
+void bench_sequence(bench_harness& h, const char* name, size_t n, const std::vector<size_t>& indexes)
+{
+	char buf[64];
+	size_t ops = bench_reps(n) * n;
+	sprintf(buf, "push/pop %s", name);
+	h.run(buf, push_pop_bench<C>(n), ops * 2);
+	C c;
+	bench_fill_with(c, n);
+	sprintf(buf, "random access %s", name);
+	h.run(buf, random_access_bench<C>(c, indexes), ops);
+	sprintf(buf, "iterate %s", name);
+	h.run(buf, iterate_bench<C>(c), ops);
+	sprintf(buf, "copy %s", name);
+	h.run(buf, copy_bench<C>(c), ops);
+}
+
+// a payload too big for ootl::object or std::any to hold inline
+struct big_payload
+{
+	big_payload(int x = 0) { for (int i=0; i < 8; ++i) a[i] = x; }
+	bool operator==(const big_payload& x) const { return memcmp(a, x.a, sizeof(a)) == 0; }
+	int a[8];
+};
+
+int payload_value(int x) { return x; }
+int payload_value(const big_payload& x) { return x.a[0]; }
+
+template<typename T>
+struct object_copy_bench
+{
+	object_copy_bench(const object& o) : o(o) { }
+	void operator()()
+	{
+		size_t n = 0;
+		for (size_t i=0; i < bench_work; ++i)
+		{
+			object copy(o);
+			n += payload_value(copy.to<T>());
+		}
+		bench_sink += n;
+	}
+	const object& o;
+};
+
+#ifdef OOTL_BENCH_ANY
+template<typename T>
+struct any_copy_bench
+{
+	any_copy_bench(const std::any& o) : o(o) { }
+	void operator()()
+	{
+		size_t n = 0;
+		for (size_t i=0; i < bench_work; ++i)
+		{
+			std::any copy(o);
+			n += payload_value(*std::any_cast<T>(&copy));
+		}
+		bench_sink += n;
+	}
+	const std::any& o;
+};
+#endif
+
+template<typename T>
+void bench_object_copies(bench_harness& h, const char* name)
+{
+	char buf[64];
+	object o = T(1);
+	sprintf(buf, "copy object<%s>", name);
+	h.run(buf, object_copy_bench<T>(o), bench_work);
+#ifdef OOTL_BENCH_ANY
+	std::any a = T(1);
+	sprintf(buf, "copy any<%s>", name);
+	h.run(buf, any_copy_bench<T>(a), bench_work);
+#endif
+}
+
+void bench_against_std()
+{
+	static const size_t sizes[] = { 1 << 10, 1 << 16, 1 << 20 };
+	for (size_t k=0; k < sizeof(sizes) / sizeof(sizes[0]); ++k)
+	{
+		size_t n = sizes[k];
+		printf("\nootl against std, %u elements\n", (unsigned)n);
+		bench_harness h;
+		std::vector<size_t> indexes;
+		for (size_t i=0; i < n; ++i)
+			indexes.push_back(bench_random() % n);
+
+		bench_sequence<stack<int> >(h, "stack", n, indexes);
+		bench_sequence<std::vector<int> >(h, "vector", n, indexes);
+		bench_sequence<std::deque<int> >(h, "deque", n, indexes);
+		{
+			stack<int> s;
+			bench_fill_with(s, n);
+			h.run("iterate vlist iterator", iterator_bench<stack<int> >(s), bench_reps(n) * n);
+		}
+
+		{
+			size_t ops = bench_reps(n) * n;
+			h.run("append ootl::string", string_append_bench<ootl::string>(n), ops);
+			h.run("append std::string", string_append_bench<std::string>(n), ops);
+			ootl::string s("");
+			std::string t;
+			for (size_t i=0; i < n; ++i)
+			{
+				bench_push(s, 'x');
+				bench_push(t, 'x');
+			}
+			h.run("copy ootl::string", copy_bench<ootl::string>(s), ops);
+			h.run("copy std::string", copy_bench<std::string>(t), ops);
+		}
+
+		bench_lookups<hash_map<int, int> >(h, "hash_map", n);
+		bench_lookups<std::unordered_map<int, int> >(h, "unordered_map", n);
+	}
+
+	printf("\nsmall object copies\n");
+	bench_harness h;
+	bench_object_copies<int>(h, "int");
+	bench_object_copies<big_payload>(h, "32 bytes");
+}
+
+// ootl_bench [-std], which runs only the comparisons with the standard library
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || strcmp(argv[1], "-std") != 0)
+	{
+		bench_boundary_oscillation();
+		bench_fill();
+	}
+	bench_against_std();
+	return 0;
+}
@@ -0,0 +1,284 @@
+// Public Domain
+// by Christopher Diggins
+// http://www.ootl.org
+//
+// Tests of the OOTL containers. Prints each check, and returns non-zero if
+// any of them failed.
+
+#include <stdio.h>
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "..\ootl\ootl_stack.hpp"
+#include "..\ootl\ootl_tester.hpp"
+
+using namespace ootl;
+
+// a policy whose buffers don't double, so indexes are found by walking
+// the buffers instead of through the directory
+struct linear_vlist_policy : default_vlist_policy
+{
+	static size_t new_size(size_t old_size) { return old_size + 8; }
+	static const bool doubling = false;
+};
+
+// counts the items alive, to check that the bulk operations construct and
+// destroy each item once
+struct counted
+{
+	static int alive;
+	counted(int x = 0) : n(x) { ++alive; }
+	counted(const counted& x) : n(x.n) { ++alive; }
+	~counted() { --alive; }
+	bool operator==(const counted& x) const { return n == x.n; }
+	int n;
+};
+
+int counted::alive = 0;
+
+// 0, 1, 2, ... n - 1, with index 0 at the bottom
+template<typename Stack>
+void fill(Stack& s, int n)
+{
+	for (int i=0; i < n; ++i)
+		s.push(i);
+}
+
+// true if the items from the bottom are 0, 1, 2, ... count - 1
+template<typename Stack>
+bool is_sequence(const Stack& s)
+{
+	size_t n = s.count();
+	for (size_t i=0; i < n; ++i)
+		if (s[n - 1 - i] != (int)i)
+			return false;
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// bulk operations
+
+void test_bulk()
+{
+	// the first buffers hold 8, 16, 32, ... items, so these counts cross
+	// many buffer boundaries
+	stack<int> s;
+	s.push(-1);
+	s.push_n(1000, 7);
+	bool all_7 = true;
+	for (size_t i=0; i < 1000; ++i)
+		all_7 = all_7 && s[i] == 7;
+	OOTL_TEST(s.count() == 1001 && all_7 && s[1000] == -1);
+
+	std::vector<int> src(5000);
+	for (size_t i=0; i < src.size(); ++i)
+		src[i] = (int)i;
+	stack<int> a;
+	a.append_range(&src[0], &src[0] + 3);
+	a.append_range(&src[3], &src[0] + src.size());
+	OOTL_TEST(a.count() == 5000 && is_sequence(a));
+
+	std::vector<int> out(a.count());
+	a.copy_out(&out[0]);
+	OOTL_TEST(out == src);
+
+	a.pop_n(3001);
+	OOTL_TEST(a.count() == 1999 && a.top() == 1998 && is_sequence(a));
+	a.append_range(&src[1999], &src[0] + src.size());
+	OOTL_TEST(a.count() == 5000 && is_sequence(a));
+	a.pop_n(5000);
+	OOTL_TEST(a.count() == 0);
+	a.push(0);
+	OOTL_TEST(a.count() == 1 && a.top() == 0);
+
+	stack<int> copy(s);
+	OOTL_TEST(copy.count() == s.count() && copy[1000] == -1 && copy[0] == 7);
+
+	// items which aren't trivially copyable are constructed and destroyed
+	// one at a time
+	{
+		std::vector<counted> items(300);
+		for (size_t i=0; i < items.size(); ++i)
+			items[i].n = (int)i;
+		int before = counted::alive;
+		stack<counted> c;
+		c.append_range(&items[0], &items[0] + items.size());
+		c.push_n(100, counted(-1));
+		OOTL_TEST(counted::alive == before + 400);
+		c.pop_n(150);
+		OOTL_TEST(counted::alive == before + 250 && c.top().n == 249);
+		std::vector<counted> copied(c.count());
+		c.copy_out(&copied[0]);
+		OOTL_TEST(std::equal(copied.begin(), copied.end(), items.begin()));
+		c.clear();
+		OOTL_TEST(counted::alive == before + (int)copied.size());
+	}
+
+	stack<std::string> strs;
+	strs.push_n(50, std::string("abc"));
+	strs.push("top");
+	stack<std::string> strs_copy(strs);
+	OOTL_TEST(strs_copy.count() == 51 && strs_copy.top() == "top" && strs_copy[50] == "abc");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// equality
+
+void test_equality()
+{
+	// the same items, reached by different histories
+	stack<int> a;
+	fill(a, 3000);
+	stack<int> b;
+	fill(b, 5000);
+	b.pop_n(2000);
+	stack<int> c;
+	for (int i=0; i < 3000; i += 7)
+	{
+		int n = std::min(7, 3000 - i);
+		for (int j=0; j < n; ++j)
+			c.push(i + j);
+	}
+	stack<int> d(a);
+	OOTL_TEST(a == b);
+	OOTL_TEST(a == c);
+	OOTL_TEST(a == d);
+
+	// a difference in the first buffer, the last one, and one in between
+	size_t indexes[] = { 0, 5, 8, 100, 1500, 2999 };
+	for (size_t k=0; k < sizeof(indexes) / sizeof(indexes[0]); ++k)
+	{
+		b.set_at(indexes[k], -1);
+		OOTL_TEST(!(a == b));
+		OOTL_TEST(!(b == a));
+		b.set_at(indexes[k], a[indexes[k]]);
+	}
+	OOTL_TEST(a == b);
+
+	// different counts, and empty stacks
+	b.pop();
+	OOTL_TEST(!(a == b));
+	stack<int> e1;
+	stack<int> e2;
+	fill(e2, 100);
+	e2.clear();
+	OOTL_TEST(e1 == e2);
+
+	// items which are compared with operator==
+	stack<std::string> s1;
+	stack<std::string> s2;
+	for (int i=0; i < 200; ++i)
+	{
+		s1.push(std::string(i % 7 + 1, 'a'));
+		s2.push(std::string(i % 7 + 1, 'a'));
+	}
+	OOTL_TEST(s1 == s2);
+	s2.set_at(150, "b");
+	OOTL_TEST(!(s1 == s2));
+
+	// buffers which don't double
+	stack<int, linear_vlist_policy> l1;
+	stack<int, linear_vlist_policy> l2;
+	fill(l1, 1000);
+	fill(l2, 1500);
+	l2.pop_n(500);
+	OOTL_TEST(l1 == l2);
+	l2.set_at(999, -1);
+	OOTL_TEST(!(l1 == l2));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// indexing
+
+template<typename Stack>
+bool check_indexing(Stack& s, int n)
+{
+	fill(s, n);
+	if (!is_sequence(s))
+		return false;
+	// shrinking and regrowing reuses the spare buffers
+	s.pop_n(s.count() / 2 + 3);
+	fill(s, 50);
+	size_t m = s.count() - 50;
+	for (size_t i=0; i < m; ++i)
+		if (s[s.count() - 1 - i] != (int)i)
+			return false;
+	for (size_t i=0; i < 50; ++i)
+		if (s[49 - i] != (int)i)
+			return false;
+	// every position can be set
+	for (size_t i=0; i < s.count(); ++i)
+		s.set_at(i, (int)(s.count() - 1 - i));
+	return is_sequence(s);
+}
+
+void test_indexing()
+{
+	stack<int> s;
+	OOTL_TEST(check_indexing(s, 100000));
+	stack<int, linear_vlist_policy> l;
+	OOTL_TEST(check_indexing(l, 5000));
+
+	// the directory starts small and grows with the buffers
+	stack<int> t;
+	bool ok = true;
+	for (int i=0; i < 70000 && ok; ++i)
+	{
+		t.push(i);
+		if ((i & (i + 1)) == 0)
+			ok = is_sequence(t);
+	}
+	OOTL_TEST(ok && is_sequence(t));
+
+	// swapping exchanges the directories too
+	stack<int> u;
+	fill(u, 10);
+	t.swap(u);
+	OOTL_TEST(t.count() == 10 && is_sequence(t) && u.count() == 70000 && is_sequence(u));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// iterators
+
+void test_iterators()
+{
+	stack<int> s;
+	fill(s, 1000);
+	OOTL_TEST(s.end() - s.begin() == 1000);
+	OOTL_TEST(*s.begin() == 0 && *(s.end() - 1) == 999 && s.begin()[500] == 500);
+	OOTL_TEST(std::accumulate(s.begin(), s.end(), 0) == 999 * 1000 / 2);
+
+	stack<int>::iterator i = s.begin();
+	i += 100;
+	--i;
+	i++;
+	OOTL_TEST(*i == 100 && i - s.begin() == 100 && s.begin() < i && i <= s.end());
+
+	// the algorithms see the items in index order, from the bottom
+	std::reverse(s.begin(), s.end());
+	OOTL_TEST(s.top() == 0 && s[999] == 999);
+	std::sort(s.begin(), s.end());
+	OOTL_TEST(is_sequence(s));
+	OOTL_TEST(std::lower_bound(s.begin(), s.end(), 777) - s.begin() == 777);
+
+	const stack<int>& cs = s;
+	stack<int>::const_iterator ci = std::find(cs.begin(), cs.end(), 500);
+	OOTL_TEST(ci != cs.end() && ci - cs.begin() == 500);
+	stack<int>::const_iterator converted = s.begin();
+	OOTL_TEST(converted == cs.begin());
+
+	std::vector<int> v(s.begin(), s.end());
+	OOTL_TEST(v.size() == 1000 && v[0] == 0 && v[999] == 999);
+}
+
+int main()
+{
+	test_bulk();
+	test_equality();
+	test_indexing();
+	test_iterators();
+	printf(ootl_test_failures == 0 ? "ootl tests passed\n" : "%d ootl tests failed\n", ootl_test_failures);
+	return ootl_test_failures == 0 ? 0 : 1;
+}